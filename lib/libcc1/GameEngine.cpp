@@ -0,0 +1,1014 @@
+/******************************************************************************
+ * This file is part of CCTools.                                              *
+ *                                                                            *
+ * CCTools is free software: you can redistribute it and/or modify            *
+ * it under the terms of the GNU General Public License as published by       *
+ * the Free Software Foundation, either version 3 of the License, or          *
+ * (at your option) any later version.                                        *
+ *                                                                            *
+ * CCTools is distributed in the hope that it will be useful,                 *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with CCTools.  If not, see <http://www.gnu.org/licenses/>.           *
+ ******************************************************************************/
+
+#include "GameEngine.h"
+
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+
+#define DIR_BIT(dir)    (1 << (dir))
+#define REVERSE(dir)    (((dir) + 2) & 3)
+
+static bool isPlayer(tile_t tile)
+{
+    return (tile >= ccl::TilePlayer_N && tile <= ccl::TilePlayer_E)
+        || (tile >= ccl::TilePlayerSwim_N && tile <= ccl::TilePlayerSwim_E);
+}
+
+static bool isBlock(tile_t tile)
+{
+    return tile == ccl::TileBlock || (tile >= ccl::TileBlock_N && tile <= ccl::TileBlock_E);
+}
+
+static bool isCreature(tile_t tile)
+{
+    return isPlayer(tile) || isBlock(tile) || MONSTER_TILE(tile);
+}
+
+static bool isIce(tile_t tile)
+{
+    return tile == ccl::TileIce || (tile >= ccl::TileIce_SE && tile <= ccl::TileIce_NE);
+}
+
+static bool isForce(tile_t tile)
+{
+    return FORCE_TILE(tile) || tile == ccl::TileForce_Rand;
+}
+
+// Sides of the cell which are walled off, as DIR_BIT()s
+static int cellWalls(tile_t tile)
+{
+    switch (tile) {
+    case ccl::TileBarrier_N:    return DIR_BIT(0);
+    case ccl::TileBarrier_W:    return DIR_BIT(1);
+    case ccl::TileBarrier_S:    return DIR_BIT(2);
+    case ccl::TileBarrier_E:    return DIR_BIT(3);
+    case ccl::TileBarrier_SE:   return DIR_BIT(2) | DIR_BIT(3);
+    case ccl::TileIce_SE:       return DIR_BIT(0) | DIR_BIT(1);
+    case ccl::TileIce_SW:       return DIR_BIT(0) | DIR_BIT(3);
+    case ccl::TileIce_NW:       return DIR_BIT(2) | DIR_BIT(3);
+    case ccl::TileIce_NE:       return DIR_BIT(2) | DIR_BIT(1);
+    default:                    return 0;
+    }
+}
+
+static int forceDirection(tile_t tile)
+{
+    switch (tile) {
+    case ccl::TileForce_N:  return 0;
+    case ccl::TileForce_W:  return 1;
+    case ccl::TileForce_S:  return 2;
+    case ccl::TileForce_E:  return 3;
+    default:                return -1;
+    }
+}
+
+// Direction out of an ice corner for a creature entering it moving in dir
+static int deflect(tile_t corner, int dir)
+{
+    const int open = ~cellWalls(corner) & 0xF;
+    for (int out = 0; out < 4; ++out) {
+        if ((open & DIR_BIT(out)) && out != REVERSE(dir))
+            return out;
+    }
+    return dir;
+}
+
+static tile_t faceTile(tile_t tile, int dir)
+{
+    if (isPlayer(tile))
+        return (tile_t)(ccl::TilePlayer_N + dir);
+    if (MONSTER_TILE(tile))
+        return (tile_t)((tile & 0xFC) | dir);
+    return tile;
+}
+
+
+std::unique_ptr<ccl::GameEngine> ccl::GameEngine::create(Ruleset ruleset)
+{
+    switch (ruleset) {
+    case RulesetMS:
+        return std::unique_ptr<GameEngine>(new MSEngine);
+    case RulesetLynx:
+        return std::unique_ptr<GameEngine>(new LynxEngine);
+    default:
+        return nullptr;
+    }
+}
+
+ccl::Ruleset ccl::GameEngine::rulesetFor(const Levelset* levelset)
+{
+    if (levelset->type() == Levelset::TypeLynx || levelset->type() == Levelset::TypeLynxPG)
+        return RulesetLynx;
+    return RulesetMS;
+}
+
+void ccl::GameEngine::reset(const LevelData* level, uint32_t seed)
+{
+    memset(&m_state, 0, sizeof(m_state));
+    for (int y = 0; y < CCL_HEIGHT; ++y) {
+        for (int x = 0; x < CCL_WIDTH; ++x) {
+            m_state.fg[cell(x, y)] = level->map().getFG(x, y);
+            m_state.bg[cell(x, y)] = level->map().getBG(x, y);
+        }
+    }
+    m_state.chipsLeft = level->chips();
+    m_state.timeLimit = (uint32_t)level->timer() * TicksPerSecond;
+    m_state.rng = seed;
+    m_state.status = GameRunning;
+    m_traps = level->traps();
+    m_clones = level->clones();
+
+    // If there are several players, the last one in reading order is used
+    const int start = level->map().findTiles(TilePlayer_N, TilePlayer_E, LevelMap::LayerFG).last();
+    GameCreature& player = m_state.creatures[GameState::PlayerIndex];
+    if (start >= 0) {
+        player.x = (uint8_t)TileMask::cellX(start);
+        player.y = (uint8_t)TileMask::cellY(start);
+        player.tile = m_state.fg[start];
+        player.dir = (uint8_t)(player.tile - TilePlayer_N);
+    } else {
+        player.tile = TilePlayer_S;
+        player.dir = 2;
+        player.flags = GameCreature::Dead;
+        m_state.status = GameDied;
+    }
+    m_state.numCreatures = 1;
+
+    setup(level);
+}
+
+ccl::GameStatus ccl::GameEngine::tick(Direction input)
+{
+    m_inputTaken = false;
+    if (m_state.status == GameRunning)
+        advance(input);
+    return (GameStatus)m_state.status;
+}
+
+int ccl::GameEngine::timeLeft() const
+{
+    if (m_state.timeLimit == 0)
+        return -1;
+    return (m_state.tick < m_state.timeLimit) ? (int)(m_state.timeLimit - m_state.tick) : 0;
+}
+
+bool ccl::GameEngine::neighbor(int& x, int& y, int dir)
+{
+    switch (dir) {
+    case 0:
+        if (y <= 0)
+            return false;
+        --y;
+        return true;
+    case 1:
+        if (x <= 0)
+            return false;
+        --x;
+        return true;
+    case 2:
+        if (y >= CCL_HEIGHT - 1)
+            return false;
+        ++y;
+        return true;
+    case 3:
+        if (x >= CCL_WIDTH - 1)
+            return false;
+        ++x;
+        return true;
+    default:
+        return false;
+    }
+}
+
+void ccl::GameEngine::liftCreature(const GameCreature& cr)
+{
+    const int pos = cell(cr.x, cr.y);
+    m_state.fg[pos] = m_state.bg[pos];
+    m_state.bg[pos] = TileFloor;
+}
+
+void ccl::GameEngine::placeCreature(const GameCreature& cr)
+{
+    const int pos = cell(cr.x, cr.y);
+    m_state.bg[pos] = m_state.fg[pos];
+    m_state.fg[pos] = cr.tile;
+}
+
+int ccl::GameEngine::addCreature(int x, int y, tile_t tile, int dir, uint8_t flags)
+{
+    if (m_state.numCreatures >= GameState::MaxCreatures)
+        return -1;
+
+    const int index = m_state.numCreatures++;
+    GameCreature& cr = m_state.creatures[index];
+    cr.x = (uint8_t)x;
+    cr.y = (uint8_t)y;
+    cr.tile = tile;
+    cr.dir = (uint8_t)dir;
+    cr.flags = flags;
+    return index;
+}
+
+void ccl::GameEngine::killCreature(int index)
+{
+    GameCreature& cr = m_state.creatures[index];
+    const int pos = cell(cr.x, cr.y);
+    if (m_state.fg[pos] == cr.tile) {
+        m_state.fg[pos] = m_state.bg[pos];
+        m_state.bg[pos] = TileFloor;
+    }
+    stopSliding(index);
+    cr.flags |= GameCreature::Dead;
+    if (index == GameState::PlayerIndex)
+        m_state.status = GameDied;
+}
+
+int ccl::GameEngine::findCreature(int x, int y) const
+{
+    for (int i = 0; i < m_state.numCreatures; ++i) {
+        const GameCreature& cr = m_state.creatures[i];
+        if (cr.x == x && cr.y == y && !(cr.flags & GameCreature::Dead))
+            return i;
+    }
+    return -1;
+}
+
+void ccl::GameEngine::startSliding(int index)
+{
+    GameCreature& cr = m_state.creatures[index];
+    if (cr.flags & GameCreature::Sliding)
+        return;
+    cr.flags |= GameCreature::Sliding;
+    m_state.slipList[m_state.numSlipping++] = (uint8_t)index;
+}
+
+void ccl::GameEngine::stopSliding(int index)
+{
+    GameCreature& cr = m_state.creatures[index];
+    if (!(cr.flags & GameCreature::Sliding))
+        return;
+    cr.flags &= ~GameCreature::Sliding;
+
+    uint8_t* slipEnd = m_state.slipList + m_state.numSlipping;
+    uint8_t* entry = std::find(m_state.slipList, slipEnd, (uint8_t)index);
+    if (entry != slipEnd) {
+        std::copy(entry + 1, slipEnd, entry);
+        --m_state.numSlipping;
+    }
+}
+
+void ccl::GameEngine::removeDeadCreatures()
+{
+    // The player keeps index 0 even when dead
+    uint8_t remap[GameState::MaxCreatures];
+    int count = 1;
+    remap[0] = 0;
+    for (int i = 1; i < m_state.numCreatures; ++i) {
+        if (m_state.creatures[i].flags & GameCreature::Dead)
+            continue;
+        remap[i] = (uint8_t)count;
+        m_state.creatures[count++] = m_state.creatures[i];
+    }
+    if (count == m_state.numCreatures)
+        return;
+    m_state.numCreatures = (uint8_t)count;
+
+    // Dead creatures were already taken out of the slip list
+    for (int i = 0; i < m_state.numSlipping; ++i)
+        m_state.slipList[i] = remap[m_state.slipList[i]];
+}
+
+bool ccl::GameEngine::trapOpen(int x, int y) const
+{
+    for (const Trap& trap : m_traps) {
+        if (trap.trap.X != x || trap.trap.Y != y)
+            continue;
+        if (trap.button.X < 0 || trap.button.X >= CCL_WIDTH
+                || trap.button.Y < 0 || trap.button.Y >= CCL_HEIGHT)
+            continue;
+        const int button = cell(trap.button.X, trap.button.Y);
+        if (m_state.bg[button] == TileTrapButton && isCreature(m_state.fg[button]))
+            return true;
+    }
+    return false;
+}
+
+void ccl::GameEngine::toggleWalls()
+{
+    for (tile_t* layer : { m_state.fg, m_state.bg }) {
+        for (int pos = 0; pos < CCL_WIDTH * CCL_HEIGHT; ++pos) {
+            if (layer[pos] == TileToggleWall)
+                layer[pos] = TileToggleFloor;
+            else if (layer[pos] == TileToggleFloor)
+                layer[pos] = TileToggleWall;
+        }
+    }
+}
+
+void ccl::GameEngine::turnTanks()
+{
+    for (int i = 1; i < m_state.numCreatures; ++i) {
+        GameCreature& cr = m_state.creatures[i];
+        if ((cr.flags & GameCreature::Dead) || (cr.tile & 0xFC) != TileTank_N)
+            continue;
+        const int pos = cell(cr.x, cr.y);
+        const bool shown = (m_state.fg[pos] == cr.tile);
+        cr.dir = (uint8_t)REVERSE(cr.dir);
+        cr.tile = faceTile(cr.tile, cr.dir);
+        if (shown)
+            m_state.fg[pos] = cr.tile;
+    }
+}
+
+uint32_t ccl::GameEngine::random()
+{
+    m_state.rng = (m_state.rng * 1103515245U) + 12345U;
+    return (m_state.rng >> 16) & 0x7FFF;
+}
+
+bool ccl::GameEngine::canEnter(int x, int y, tile_t tile, int dir, int flags) const
+{
+    if (!(flags & MoveNoSource)) {
+        const tile_t from = terrain(x, y);
+        if (cellWalls(from) & DIR_BIT(dir))
+            return false;
+        if (from == TileTrap && !trapOpen(x, y))
+            return false;
+    }
+
+    int nx = x, ny = y;
+    if (!neighbor(nx, ny, dir))
+        return false;
+    const int pos = cell(nx, ny);
+    const tile_t top = m_state.fg[pos];
+
+    if (isCreature(top)) {
+        if (cellWalls(m_state.bg[pos]) & DIR_BIT(REVERSE(dir)))
+            return false;
+        if (isPlayer(tile)) {
+            if (MONSTER_TILE(top))
+                return true;
+            if (isBlock(top) && (flags & MovePushing))
+                return canEnter(nx, ny, top, dir, 0);
+            return false;
+        }
+        // Monsters and sliding blocks can run into the player
+        return isPlayer(top);
+    }
+
+    if (cellWalls(top) & DIR_BIT(REVERSE(dir)))
+        return false;
+
+    if (isPlayer(tile)) {
+        switch (top) {
+        case TileWall:
+        case TileInvisWall:
+        case TileAppearingWall:
+        case TileBlueWall:
+        case TileToggleWall:
+        case TileCloner:
+        case TileIceBlock:
+            return false;
+        case TileDoor_Blue:
+        case TileDoor_Red:
+        case TileDoor_Green:
+        case TileDoor_Yellow:
+            return m_state.keys[top - TileDoor_Blue] != 0;
+        case TileSocket:
+            return m_state.chipsLeft == 0;
+        default:
+            return top < TilePlayerSplash || top > TileExitAnim3;
+        }
+    }
+
+    if (isBlock(tile)) {
+        switch (top) {
+        case TileFloor:
+        case TileWater:
+        case TileFire:
+        case TileBomb:
+        case TileIce:
+        case TileIce_SE:
+        case TileIce_SW:
+        case TileIce_NW:
+        case TileIce_NE:
+        case TileForce_N:
+        case TileForce_W:
+        case TileForce_S:
+        case TileForce_E:
+        case TileForce_Rand:
+        case TileTeleport:
+        case TileTrap:
+        case TileToggleFloor:
+        case TileToggleButton:
+        case TileCloneButton:
+        case TileTrapButton:
+        case TileTankButton:
+        case TileBarrier_N:
+        case TileBarrier_W:
+        case TileBarrier_S:
+        case TileBarrier_E:
+        case TileBarrier_SE:
+        case TileGravel:
+        case TileHint:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    // Monsters; this matches the tiles CheckMove() considers blocked
+    if (top == TileWall || top == TileChip || top == TileToggleWall
+        || top == TileInvisWall || top == TileDirt
+        || (top >= TileExit && top <= TileDoor_Yellow)
+        || (top >= TileBlueFloor && top <= TileSocket)
+        || (top >= TileAppearingWall && top <= TilePopUpWall)
+        || (top >= TileCloner && top <= TileExitAnim3)
+        || (top >= TileFlippers && top <= TileForceBoots)
+        || (top >= NUM_TILE_TYPES))
+        return false;
+    if (ruleset() == RulesetLynx && top >= TileKey_Blue && top <= TileKey_Yellow)
+        return false;
+    if (top == TileFire) {
+        const tile_t kind = tile & 0xFC;
+        if (kind == TileBug_N || kind == TileWalker_N)
+            return false;
+    }
+    return true;
+}
+
+bool ccl::GameEngine::moveCreature(int index, int dir, int flags)
+{
+    GameCreature& cr = m_state.creatures[index];
+    const bool player = (index == GameState::PlayerIndex);
+    const int from = cell(cr.x, cr.y);
+    const bool shown = !(flags & MoveNoSource) && m_state.fg[from] == cr.tile;
+
+    cr.dir = (uint8_t)dir;
+    cr.tile = faceTile(cr.tile, dir);
+    if (shown)
+        m_state.fg[from] = cr.tile;
+
+    if (!canEnter(cr.x, cr.y, cr.tile, dir, flags)) {
+        // Bumping into a hidden wall reveals it
+        int nx = cr.x, ny = cr.y;
+        if (player && neighbor(nx, ny, dir) && m_state.fg[cell(nx, ny)] == TileAppearingWall)
+            m_state.fg[cell(nx, ny)] = TileWall;
+        return false;
+    }
+
+    int nx = cr.x, ny = cr.y;
+    neighbor(nx, ny, dir);
+    const int to = cell(nx, ny);
+
+    if (player && isBlock(m_state.fg[to])) {
+        int block = findCreature(nx, ny);
+        if (block < 0)
+            block = addCreature(nx, ny, m_state.fg[to], dir, GameCreature::Block);
+        if (block < 0 || !moveCreature(block, dir, 0))
+            return false;
+        if (!(m_state.creatures[block].flags & GameCreature::Sliding))
+            m_state.creatures[block].flags |= GameCreature::Dead;
+    }
+
+    if (shown) {
+        liftCreature(cr);
+        if (player && m_state.fg[from] == TilePopUpWall)
+            m_state.fg[from] = TileWall;
+    }
+    cr.x = (uint8_t)nx;
+    cr.y = (uint8_t)ny;
+
+    const tile_t top = m_state.fg[to];
+    if (isCreature(top)) {
+        // Either the player walked into something, or something hit the
+        // player; it's fatal either way
+        m_state.creatures[GameState::PlayerIndex].flags |= GameCreature::Dead;
+        m_state.status = GameDied;
+        if (player)
+            cr.flags |= GameCreature::Dead;
+        else
+            m_state.fg[to] = cr.tile;
+        return true;
+    }
+
+    placeCreature(cr);
+    enterCell(index);
+    return true;
+}
+
+void ccl::GameEngine::enterCell(int index)
+{
+    GameCreature& cr = m_state.creatures[index];
+    const int pos = cell(cr.x, cr.y);
+    tile_t& under = m_state.bg[pos];
+
+    if (index == GameState::PlayerIndex) {
+        switch (under) {
+        case TileChip:
+            if (m_state.chipsLeft > 0)
+                --m_state.chipsLeft;
+            under = TileFloor;
+            break;
+        case TileKey_Blue:
+        case TileKey_Red:
+        case TileKey_Green:
+        case TileKey_Yellow:
+            if (m_state.keys[under - TileKey_Blue] < 255)
+                ++m_state.keys[under - TileKey_Blue];
+            under = TileFloor;
+            break;
+        case TileFlippers:
+        case TileFireBoots:
+        case TileIceSkates:
+        case TileForceBoots:
+            m_state.boots[under - TileFlippers] = 1;
+            under = TileFloor;
+            break;
+        case TileDoor_Blue:
+        case TileDoor_Red:
+        case TileDoor_Yellow:
+            --m_state.keys[under - TileDoor_Blue];
+            under = TileFloor;
+            break;
+        case TileDoor_Green:
+        case TileDirt:
+        case TileBlueFloor:
+        case TileSocket:
+            under = TileFloor;
+            break;
+        case TileThief:
+            memset(m_state.boots, 0, sizeof(m_state.boots));
+            break;
+        case TileWater:
+            if (!m_state.boots[0]) {
+                m_state.fg[pos] = TilePlayerSplash;
+                m_state.status = GameDied;
+                return;
+            }
+            cr.tile = (tile_t)(TilePlayerSwim_N + cr.dir);
+            m_state.fg[pos] = cr.tile;
+            break;
+        case TileFire:
+            if (!m_state.boots[1]) {
+                m_state.fg[pos] = TilePlayerFire;
+                m_state.status = GameDied;
+                return;
+            }
+            break;
+        case TileBomb:
+            m_state.fg[pos] = TilePlayerBurnt;
+            under = TileFloor;
+            m_state.status = GameDied;
+            return;
+        case TileExit:
+            m_state.fg[pos] = TilePlayerExit;
+            m_state.status = GameWon;
+            return;
+        default:
+            break;
+        }
+    } else if (cr.flags & GameCreature::Block) {
+        if (under == TileWater) {
+            killCreature(index);
+            m_state.fg[pos] = TileDirt;
+            return;
+        }
+        if (under == TileBomb) {
+            killCreature(index);
+            m_state.fg[pos] = TileFloor;
+            return;
+        }
+    } else {
+        const tile_t kind = cr.tile & 0xFC;
+        if ((under == TileWater && kind != TileGlider_N)
+                || (under == TileFire && kind != TileFireball_N)) {
+            killCreature(index);
+            return;
+        }
+        if (under == TileBomb) {
+            killCreature(index);
+            m_state.fg[pos] = TileFloor;
+            return;
+        }
+    }
+
+    switch (under) {
+    case TileToggleButton:
+    case TileTankButton:
+    case TileCloneButton:
+        pressButton(cr.x, cr.y);
+        break;
+    default:
+        break;
+    }
+    if (cr.flags & GameCreature::Dead)
+        return;
+
+    // Work out whether the creature keeps sliding
+    const bool player = (index == GameState::PlayerIndex);
+    bool slide = false;
+    if (isIce(under)) {
+        slide = !(player && m_state.boots[2]);
+        if (slide && under != TileIce) {
+            cr.dir = (uint8_t)deflect(under, cr.dir);
+            cr.tile = faceTile(cr.tile, cr.dir);
+            m_state.fg[pos] = cr.tile;
+        }
+    } else if (isForce(under)) {
+        slide = !(player && m_state.boots[3]);
+    } else if (under == TileTeleport) {
+        teleport(index);
+        slide = true;
+    }
+
+    if (slide)
+        startSliding(index);
+    else
+        stopSliding(index);
+}
+
+bool ccl::GameEngine::teleport(int index)
+{
+    // Search backwards in reading order for a free teleport.  Under MS rules
+    // the teleport's exit must also be open; Lynx checks that afterwards.
+    GameCreature& cr = m_state.creatures[index];
+    const int start = cell(cr.x, cr.y);
+    for (int step = 1; step < CCL_WIDTH * CCL_HEIGHT; ++step) {
+        const int pos = (start - step + (CCL_WIDTH * CCL_HEIGHT)) % (CCL_WIDTH * CCL_HEIGHT);
+        if (m_state.fg[pos] != TileTeleport)
+            continue;
+        const int x = TileMask::cellX(pos), y = TileMask::cellY(pos);
+        if (ruleset() == RulesetMS
+                && !canEnter(x, y, cr.tile, cr.dir, MoveNoSource | (index == 0 ? MovePushing : 0)))
+            continue;
+
+        liftCreature(cr);
+        cr.x = (uint8_t)x;
+        cr.y = (uint8_t)y;
+        placeCreature(cr);
+        return true;
+    }
+    return false;
+}
+
+int ccl::GameEngine::chooseMonsterMove(int index)
+{
+    GameCreature& cr = m_state.creatures[index];
+    const tile_t kind = cr.tile & 0xFC;
+    const int facing = cr.dir;
+    int choices[4] = { -1, -1, -1, -1 };
+
+    switch (kind) {
+    case TileTank_N:
+        choices[0] = facing;
+        break;
+    case TileWalker_N:
+        {
+            choices[0] = facing;
+            const int turn = (int)(random() % 3);
+            for (int i = 0; i < 3; ++i)
+                choices[i + 1] = (facing + 1 + ((turn + i) % 3)) & 3;
+        }
+        break;
+    case TileBlob_N:
+        {
+            const int first = (int)(random() & 3);
+            for (int i = 0; i < 4; ++i)
+                choices[i] = (first + i) & 3;
+        }
+        break;
+    case TileTeeth_N:
+        {
+            const GameCreature& player = m_state.player();
+            const int dx = player.x - cr.x, dy = player.y - cr.y;
+            const int horiz = (dx < 0) ? 1 : (dx > 0) ? 3 : -1;
+            const int vert = (dy < 0) ? 0 : (dy > 0) ? 2 : -1;
+            if (abs(dx) > abs(dy)) {
+                choices[0] = horiz;
+                choices[1] = vert;
+            } else {
+                choices[0] = vert;
+                choices[1] = horiz;
+            }
+            if (choices[0] < 0)
+                return -1;
+        }
+        break;
+    default:
+        {
+            Direction dirs[4];
+            GetPreferredDirections(cr.tile, dirs);
+            for (int i = 0; i < 4; ++i)
+                choices[i] = (dirs[i] == DirInvalid) ? -1 : (int)(dirs[i] - DirNorth);
+        }
+        break;
+    }
+
+    for (int dir : choices) {
+        if (dir >= 0 && canEnter(cr.x, cr.y, cr.tile, dir, 0))
+            return dir;
+    }
+
+    // Teeth still turn to face the player when they can't move
+    if (kind == TileTeeth_N) {
+        const int pos = cell(cr.x, cr.y);
+        const bool shown = (m_state.fg[pos] == cr.tile);
+        cr.dir = (uint8_t)choices[0];
+        cr.tile = faceTile(cr.tile, cr.dir);
+        if (shown)
+            m_state.fg[pos] = cr.tile;
+    }
+    return -1;
+}
+
+bool ccl::GameEngine::slideCreature(int index)
+{
+    GameCreature& cr = m_state.creatures[index];
+    const tile_t under = terrain(cr.x, cr.y);
+    int dir = cr.dir;
+    if (under == TileForce_Rand)
+        dir = (int)(random() & 3);
+    else if (FORCE_TILE(under))
+        dir = forceDirection(under);
+
+    if (moveCreature(index, dir, (index == GameState::PlayerIndex) ? MovePushing : 0))
+        return true;
+
+    // Sliding into something on ice bounces back the other way, as does
+    // a blocked teleport exit under Lynx rules
+    if (isIce(under) || (under == TileTeleport && ruleset() == RulesetLynx)) {
+        const int pos = cell(cr.x, cr.y);
+        const bool shown = (m_state.fg[pos] == cr.tile);
+        cr.dir = (uint8_t)REVERSE(dir);
+        cr.tile = faceTile(cr.tile, cr.dir);
+        if (shown)
+            m_state.fg[pos] = cr.tile;
+    }
+    return false;
+}
+
+void ccl::GameEngine::pressButton(int x, int y)
+{
+    switch (terrain(x, y)) {
+    case TileToggleButton:
+        toggleWalls();
+        break;
+    case TileTankButton:
+        turnTanks();
+        break;
+    case TileCloneButton:
+        for (const Clone& clone : m_clones) {
+            if (clone.button.X == x && clone.button.Y == y)
+                cloneAt(clone.clone.X, clone.clone.Y);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+void ccl::GameEngine::cloneAt(int x, int y)
+{
+    if (x < 0 || x >= CCL_WIDTH || y < 0 || y >= CCL_HEIGHT)
+        return;
+    const int pos = cell(x, y);
+    const tile_t tile = m_state.fg[pos];
+    if (m_state.bg[pos] != TileCloner)
+        return;
+
+    int dir;
+    uint8_t flags = 0;
+    if (MONSTER_TILE(tile)) {
+        dir = tile & 0x03;
+    } else if (tile >= TileBlock_N && tile <= TileBlock_E) {
+        dir = tile - TileBlock_N;
+        flags = GameCreature::Block;
+    } else {
+        return;
+    }
+
+    if (!canEnter(x, y, tile, dir, MoveNoSource))
+        return;
+    const int index = addCreature(x, y, tile, dir, flags);
+    if (index < 0)
+        return;
+
+    // The original stays in the cloner
+    moveCreature(index, dir, MoveNoSource);
+    GameCreature& clone = m_state.creatures[index];
+    if ((clone.flags & GameCreature::Block) && !(clone.flags & GameCreature::Sliding))
+        clone.flags |= GameCreature::Dead;
+}
+
+
+void ccl::MSEngine::setup(const LevelData* level)
+{
+    // Only monsters in the move list ever move, in move list order
+    for (const Point& mover : level->moveList()) {
+        if (m_state.numCreatures > MAX_MOVERS)
+            break;
+        if (mover.X < 0 || mover.X >= CCL_WIDTH || mover.Y < 0 || mover.Y >= CCL_HEIGHT)
+            continue;
+        const int pos = cell(mover.X, mover.Y);
+        const tile_t tile = m_state.fg[pos];
+        if (!MONSTER_TILE(tile) || m_state.bg[pos] == TileCloner)
+            continue;
+        if (findCreature(mover.X, mover.Y) >= 0)
+            continue;
+        addCreature(mover.X, mover.Y, tile, tile & 0x03, 0);
+    }
+}
+
+void ccl::MSEngine::advance(Direction input)
+{
+    if (m_state.timeLimit != 0 && m_state.tick >= m_state.timeLimit) {
+        m_state.status = GameTimeUp;
+        return;
+    }
+
+    // Monsters step every 4 ticks, sliding happens at twice that speed,
+    // and the player may act on any even tick
+    if ((m_state.tick & 3) == 0)
+        moveMonsters();
+    if (m_state.status == GameRunning && (m_state.tick & 1) == 0)
+        slideCreatures(input);
+    if (m_state.status == GameRunning)
+        movePlayer(input);
+
+    removeDeadCreatures();
+    GameCreature& player = m_state.creatures[GameState::PlayerIndex];
+    if (player.wait)
+        --player.wait;
+    ++m_state.tick;
+}
+
+void ccl::MSEngine::moveMonsters()
+{
+    // Clones made during this turn wait for the next one
+    const int count = m_state.numCreatures;
+    for (int i = 1; i < count; ++i) {
+        GameCreature& cr = m_state.creatures[i];
+        if (cr.flags & (GameCreature::Dead | GameCreature::Block | GameCreature::Sliding))
+            continue;
+        if (terrain(cr.x, cr.y) == TileCloner)
+            continue;
+
+        // Teeth and blobs move at half speed
+        const tile_t kind = cr.tile & 0xFC;
+        if ((kind == TileTeeth_N || kind == TileBlob_N) && (m_state.tick & 7) != 0)
+            continue;
+
+        const int dir = chooseMonsterMove(i);
+        if (dir >= 0)
+            moveCreature(i, dir, 0);
+        if (m_state.status != GameRunning)
+            return;
+    }
+}
+
+void ccl::MSEngine::slideCreatures(Direction input)
+{
+    // Work from a copy, since moving can add to or remove from the list
+    uint8_t slipping[GameState::MaxCreatures];
+    const int count = m_state.numSlipping;
+    std::copy(m_state.slipList, m_state.slipList + count, slipping);
+
+    for (int i = 0; i < count; ++i) {
+        const int index = slipping[i];
+        GameCreature& cr = m_state.creatures[index];
+        if ((cr.flags & GameCreature::Dead) || !(cr.flags & GameCreature::Sliding))
+            continue;
+
+        // Off ice, the player may override the slide with a normal move
+        if (index == GameState::PlayerIndex && !isIce(terrain(cr.x, cr.y))
+                && input != DirInvalid && cr.wait == 0)
+            continue;
+
+        slideCreature(index);
+        if (m_state.status != GameRunning)
+            return;
+    }
+}
+
+bool ccl::MSEngine::playerReady() const
+{
+    const GameCreature& player = m_state.player();
+    if (m_state.status != GameRunning || player.wait != 0 || (m_state.tick & 1))
+        return false;
+    return !(player.flags & GameCreature::Sliding) || !isIce(terrain(player.x, player.y));
+}
+
+void ccl::MSEngine::movePlayer(Direction input)
+{
+    if (input < DirNorth || input > DirEast || !playerReady())
+        return;
+
+    m_inputTaken = true;
+    if (moveCreature(GameState::PlayerIndex, input - DirNorth, MovePushing))
+        m_state.creatures[GameState::PlayerIndex].wait = 4;
+}
+
+
+void ccl::LynxEngine::setup(const LevelData*)
+{
+    // Every monster on the map moves, regardless of the move list
+    for (int pos = 0; pos < CCL_WIDTH * CCL_HEIGHT; ++pos) {
+        const tile_t tile = m_state.fg[pos];
+        if (!MONSTER_TILE(tile) || m_state.bg[pos] == TileCloner)
+            continue;
+        if (addCreature(TileMask::cellX(pos), TileMask::cellY(pos), tile, tile & 0x03, 0) < 0)
+            break;
+    }
+}
+
+void ccl::LynxEngine::advance(Direction input)
+{
+    if (m_state.timeLimit != 0 && m_state.tick >= m_state.timeLimit) {
+        m_state.status = GameTimeUp;
+        return;
+    }
+
+    // Creatures are scanned from the end of the list, so the player goes
+    // last.  Clones made during the scan first move on the next tick.
+    for (int i = m_state.numCreatures - 1; i >= 0; --i) {
+        moveCreatureTurn(i, input);
+        if (m_state.status != GameRunning)
+            break;
+    }
+
+    removeDeadCreatures();
+    for (int i = 0; i < m_state.numCreatures; ++i) {
+        if (m_state.creatures[i].wait)
+            --m_state.creatures[i].wait;
+    }
+    ++m_state.tick;
+}
+
+bool ccl::LynxEngine::playerReady() const
+{
+    // While sliding, the player can only steer off of force floors
+    const GameCreature& player = m_state.player();
+    if (m_state.status != GameRunning || player.wait != 0)
+        return false;
+    return !(player.flags & GameCreature::Sliding) || isForce(terrain(player.x, player.y));
+}
+
+void ccl::LynxEngine::moveCreatureTurn(int index, Direction input)
+{
+    // A move takes 4 ticks, sliding takes 2, and teeth and blobs take 8
+    GameCreature& cr = m_state.creatures[index];
+    if ((cr.flags & GameCreature::Dead) || cr.wait != 0)
+        return;
+
+    const bool player = (index == GameState::PlayerIndex);
+    const bool haveInput = (input >= DirNorth && input <= DirEast);
+    const int dir = haveInput ? (int)(input - DirNorth) : -1;
+
+    if (cr.flags & GameCreature::Sliding) {
+        // The player may step off a force floor, but not back against it
+        const tile_t under = terrain(cr.x, cr.y);
+        if (player && haveInput && isForce(under)
+                && (under == TileForce_Rand || dir != REVERSE(forceDirection(under)))) {
+            m_inputTaken = true;
+            if (moveCreature(index, dir, MovePushing)) {
+                cr.wait = 4;
+                return;
+            }
+        }
+        slideCreature(index);
+        cr.wait = 2;
+        return;
+    }
+
+    if (player) {
+        m_inputTaken = haveInput;
+        if (haveInput && moveCreature(index, dir, MovePushing))
+            cr.wait = 4;
+        return;
+    }
+    if ((cr.flags & GameCreature::Block) || terrain(cr.x, cr.y) == TileCloner)
+        return;
+
+    const int move = chooseMonsterMove(index);
+    if (move >= 0)
+        moveCreature(index, move, 0);
+    const tile_t kind = cr.tile & 0xFC;
+    cr.wait = (kind == TileTeeth_N || kind == TileBlob_N) ? 8 : 4;
+}
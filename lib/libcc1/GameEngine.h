@@ -0,0 +1,192 @@
+/******************************************************************************
+ * This file is part of CCTools.                                              *
+ *                                                                            *
+ * CCTools is free software: you can redistribute it and/or modify            *
+ * it under the terms of the GNU General Public License as published by       *
+ * the Free Software Foundation, either version 3 of the License, or          *
+ * (at your option) any later version.                                        *
+ *                                                                            *
+ * CCTools is distributed in the hope that it will be useful,                 *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with CCTools.  If not, see <http://www.gnu.org/licenses/>.           *
+ ******************************************************************************/
+
+#ifndef _GAMEENGINE_H
+#define _GAMEENGINE_H
+
+#include "GameLogic.h"
+
+namespace ccl {
+
+enum Ruleset { RulesetMS, RulesetLynx };
+
+enum GameStatus {
+    GameRunning,
+    GameWon,        // Player reached the exit
+    GameDied,       // Player was killed (or the level has no player)
+    GameTimeUp,     // The time limit ran out
+};
+
+struct GameCreature {
+    uint8_t x, y;
+    tile_t tile;        // Tile as drawn on the map, including its facing
+    uint8_t dir;        // Direction of travel, 0..3 = N, W, S, E
+    uint8_t flags;
+    uint8_t wait;       // Ticks until the creature may move again
+
+    enum Flags {
+        Dead = 0x01,        // Removed at the end of the tick
+        Block = 0x02,       // A block, only tracked while it slides
+        Sliding = 0x04,     // In the slip list
+    };
+};
+
+/* The complete, fixed-size state of a running level.  States can be copied
+ * freely (e.g. by a search), and stepping never allocates. */
+struct GameState {
+    enum { MaxCreatures = 255, PlayerIndex = 0 };
+
+    tile_t fg[CCL_WIDTH * CCL_HEIGHT];
+    tile_t bg[CCL_WIDTH * CCL_HEIGHT];
+
+    // Index 0 is always the player; monsters follow in move order
+    GameCreature creatures[MaxCreatures];
+    uint8_t numCreatures;
+
+    // Creature indices, in the order they started sliding
+    uint8_t slipList[MaxCreatures];
+    uint8_t numSlipping;
+
+    uint8_t keys[4];        // Blue, Red, Green, Yellow
+    uint8_t boots[4];       // Flippers, Fire, Skates, Force
+    uint16_t chipsLeft;
+    uint8_t status;         // GameStatus
+    uint32_t tick;
+    uint32_t timeLimit;     // In ticks, 0 for untimed levels
+    uint32_t rng;
+
+    const GameCreature& player() const { return creatures[PlayerIndex]; }
+};
+
+/* Deterministic, headless CC1 simulation.  Time is measured in ticks of
+ * 1/20 second, matching the resolution used by Tile World. */
+class GameEngine {
+public:
+    enum { TicksPerSecond = 20 };
+
+    GameEngine() : m_inputTaken() { }
+    virtual ~GameEngine() { }
+
+    static std::unique_ptr<GameEngine> create(Ruleset ruleset);
+    static Ruleset rulesetFor(const Levelset* levelset);
+    virtual Ruleset ruleset() const = 0;
+
+    // Loads the level's initial state.  The level is not referenced after
+    // this returns.
+    void reset(const LevelData* level, uint32_t seed = 0);
+
+    // Advances one tick with the given player input (DirInvalid for none)
+    GameStatus tick(Direction input);
+
+    // Whether the last tick acted on the player's input.  Input given
+    // while the player is still busy with a move is ignored.
+    bool inputTaken() const { return m_inputTaken; }
+
+    // Whether input given to the next tick would be acted on
+    virtual bool playerReady() const = 0;
+
+    const GameState& state() const { return m_state; }
+    void restore(const GameState& state) { m_state = state; }
+    GameStatus status() const { return (GameStatus)m_state.status; }
+
+    // Ticks remaining, or -1 for untimed levels
+    int timeLeft() const;
+
+protected:
+    GameState m_state;
+    bool m_inputTaken;
+    std::vector<ccl::Trap> m_traps;
+    std::vector<ccl::Clone> m_clones;
+
+    virtual void setup(const LevelData* level) = 0;
+    virtual void advance(Direction input) = 0;
+
+    static int cell(int x, int y) { return (y * CCL_WIDTH) + x; }
+    static bool neighbor(int& x, int& y, int dir);
+
+    // What a creature standing at (x, y) is standing on
+    tile_t terrain(int x, int y) const { return m_state.bg[cell(x, y)]; }
+
+    // Moves the creature's tile between cells, leaving the old cell's
+    // lower layer behind and pushing the new cell's top tile down
+    void liftCreature(const GameCreature& cr);
+    void placeCreature(const GameCreature& cr);
+
+    int addCreature(int x, int y, tile_t tile, int dir, uint8_t flags);
+    void killCreature(int index);
+    int findCreature(int x, int y) const;
+    void startSliding(int index);
+    void stopSliding(int index);
+    void removeDeadCreatures();
+
+    bool trapOpen(int x, int y) const;
+    void toggleWalls();
+    void turnTanks();
+
+    uint32_t random();
+
+    // Movement rules shared by both rulesets
+    enum MoveFlags {
+        MovePushing = 0x1,      // Player is allowed to push blocks
+        MoveNoSource = 0x2,     // Ignore the cell being left (cloners, teleports)
+    };
+
+    bool canEnter(int x, int y, tile_t tile, int dir, int flags) const;
+    bool moveCreature(int index, int dir, int flags);
+    void enterCell(int index);
+    bool teleport(int index);
+    int chooseMonsterMove(int index);
+    bool slideCreature(int index);
+    void pressButton(int x, int y);
+    void cloneAt(int x, int y);
+};
+
+/* Microsoft ruleset: monsters move in move list order, and only monsters
+ * in the move list move at all */
+class MSEngine : public GameEngine {
+public:
+    Ruleset ruleset() const override { return RulesetMS; }
+    bool playerReady() const override;
+
+protected:
+    void setup(const LevelData* level) override;
+    void advance(Direction input) override;
+
+private:
+    void moveMonsters();
+    void slideCreatures(Direction input);
+    void movePlayer(Direction input);
+};
+
+/* Lynx ruleset: every monster on the map moves, scanning the creature list
+ * in reverse, and each creature times its own moves */
+class LynxEngine : public GameEngine {
+public:
+    Ruleset ruleset() const override { return RulesetLynx; }
+    bool playerReady() const override;
+
+protected:
+    void setup(const LevelData* level) override;
+    void advance(Direction input) override;
+
+private:
+    void moveCreatureTurn(int index, Direction input);
+};
+
+}
+
+#endif
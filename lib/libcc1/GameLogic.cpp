@@ -138,12 +138,18 @@ ccl::MoveState ccl::CheckMove(const LevelData* level, tile_t tile, int x, int y)
     case TileForce_Rand:
         // TODO: Blocked isn't really accurate here...
         return MoveBlocked;
+    case TileTeleport:
+        // Creatures leave a teleport in the direction they entered it
+        dirs[0] = TILE_DIR(tile);
+        dirs[1] = DirInvalid;
+        dirs[2] = DirInvalid;
+        dirs[3] = DirInvalid;
+        break;
     case TileTrap:
         state |= MoveTrapped;
-        for (const auto& trap_iter : level->traps()) {
-            if (trap_iter.trap.X == x && trap_iter.trap.Y == y
-                && level->map().getBG(trap_iter.button.X, trap_iter.button.Y) == TileTrapButton) {
-                tile_t trigger = level->map().getFG(trap_iter.button.X, trap_iter.button.Y);
+        for (const Point& button : level->linkedTrapButtons(x, y)) {
+            if (level->map().getBG(button.X, button.Y) == TileTrapButton) {
+                tile_t trigger = level->map().getFG(button.X, button.Y);
                 if (trigger == TileBlock || MOVING_TILE(trigger)
                     || (trigger >= TilePlayer_N && trigger <= TilePlayer_E))
                     state &= ~MoveTrapped;
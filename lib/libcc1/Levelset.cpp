@@ -18,14 +18,19 @@
 #include "Levelset.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cstring>
 #include <cstdlib>
+#include <exception>
+#include <mutex>
+#include <thread>
 
 #ifdef _MSC_VER
     #define snprintf _sprintf_p
 #endif
 
 ccl::LevelMap::LevelMap()
+    : m_revision()
 {
     memset(m_fgTiles, 0, CCL_WIDTH * CCL_HEIGHT * sizeof(tile_t));
     memset(m_bgTiles, 0, CCL_WIDTH * CCL_HEIGHT * sizeof(tile_t));
@@ -35,6 +40,7 @@ ccl::LevelMap& ccl::LevelMap::operator=(const ccl::LevelMap& source)
 {
     memcpy(m_fgTiles, source.m_fgTiles, CCL_WIDTH * CCL_HEIGHT * sizeof(tile_t));
     memcpy(m_bgTiles, source.m_bgTiles, CCL_WIDTH * CCL_HEIGHT * sizeof(tile_t));
+    ++m_revision;
     return *this;
 }
 
@@ -48,6 +54,7 @@ void ccl::LevelMap::copyFrom(const ccl::LevelMap& source, int srcX, int srcY,
 
     width = std::min(width, CCL_WIDTH - destX);
     height = std::min(height, CCL_HEIGHT - destY);
+    ++m_revision;
 
     for (int x = 0; x < width; ++x) {
         for (int y = 0; y < height; ++y) {
@@ -63,6 +70,7 @@ void ccl::LevelMap::push(int x, int y, tile_t tile)
 {
     m_bgTiles[(y*CCL_WIDTH) + x] = m_fgTiles[(y*CCL_WIDTH) + x];
     m_fgTiles[(y*CCL_WIDTH) + x] = tile;
+    ++m_revision;
 }
 
 tile_t ccl::LevelMap::pop(int x, int y)
@@ -70,12 +78,28 @@ tile_t ccl::LevelMap::pop(int x, int y)
     tile_t tile = m_fgTiles[(y*CCL_WIDTH) + x];
     m_fgTiles[(y*CCL_WIDTH) + x] = m_bgTiles[(y*CCL_WIDTH) + x];
     m_bgTiles[(y*CCL_WIDTH) + x] = 0;
+    ++m_revision;
     return tile;
 }
 
 long ccl::LevelMap::read(ccl::Stream* stream)
 {
     long begin = stream->tell();
+    ++m_revision;
+
+    const uint8_t* buffer = stream->buffer();
+    if (buffer) {
+        // Decode straight from memory instead of reading byte-by-byte
+        const uint8_t* src = buffer + begin;
+        const size_t srcSize = (size_t)(stream->size() - begin);
+        size_t used = ccl::Stream::decodeRLE(m_fgTiles, CCL_WIDTH * CCL_HEIGHT,
+                                             src, srcSize);
+        used += ccl::Stream::decodeRLE(m_bgTiles, CCL_WIDTH * CCL_HEIGHT,
+                                       src + used, srcSize - used);
+        stream->seek((long)used, SEEK_CUR);
+        return (long)used;
+    }
+
     stream->readRLE(m_fgTiles, CCL_WIDTH * CCL_HEIGHT);
     stream->readRLE(m_bgTiles, CCL_WIDTH * CCL_HEIGHT);
     return stream->tell() - begin;
@@ -89,25 +113,43 @@ long ccl::LevelMap::write(ccl::Stream* stream) const
     return outsize;
 }
 
+long ccl::LevelMap::encodedSize() const
+{
+    return (long)(2 * sizeof(uint16_t))
+         + ccl::Stream::rleLength(m_fgTiles, CCL_WIDTH * CCL_HEIGHT)
+         + ccl::Stream::rleLength(m_bgTiles, CCL_WIDTH * CCL_HEIGHT);
+}
+
 ccl::Point ccl::LevelMap::findNext(int x, int y, tile_t tile) const
 {
+    // Search forward from the cell after (x, y), wrapping around so that
+    // (x, y) itself is checked last
+    const ccl::TileMask found = findTiles(tile);
+    const int start = (y * CCL_WIDTH) + x;
+    int cell = found.first(start + 1);
+    if (cell < 0)
+        cell = found.first(0);
+
     ccl::Point result;
-    result.X = x;
-    result.Y = y;
-    for ( ;; ) {
-        if (++result.X >= 32) {
-            if (++result.Y >= 32)
-                result.Y = 0;
-            result.X = 0;
-        }
-        if (getFG(result.X, result.Y) == tile || getBG(result.X, result.Y) == tile)
-            return result;
-        if (result.X == x && result.Y == y) {
-            result.X = -1;
-            result.Y = -1;
-            return result;
-        }
-    }
+    result.X = (cell < 0) ? -1 : ccl::TileMask::cellX(cell);
+    result.Y = (cell < 0) ? -1 : ccl::TileMask::cellY(cell);
+    return result;
+}
+
+ccl::TileMask ccl::LevelMap::findTiles(tile_t first, tile_t last, Layers layers) const
+{
+    ccl::TileMask result;
+    if (layers & LayerFG)
+        result |= ccl::TileMask::fromLayer(m_fgTiles, first, last);
+    if (layers & LayerBG)
+        result |= ccl::TileMask::fromLayer(m_bgTiles, first, last);
+    return result;
+}
+
+int ccl::LevelMap::countTiles(tile_t tile) const
+{
+    return ccl::TileMask::fromLayer(m_fgTiles, tile, tile).count()
+         + ccl::TileMask::fromLayer(m_bgTiles, tile, tile).count();
 }
 
 
@@ -124,76 +166,112 @@ void ccl::LevelData::copyFrom(const ccl::LevelData* init)
     m_traps = init->m_traps;
     m_clones = init->m_clones;
     m_moveList = init->m_moveList;
+    listsChanged();
 }
 
-std::list<ccl::Point> ccl::LevelData::linkedTraps(int x, int y) const
+template <typename Item, typename KeyFunc, typename ValueFunc>
+void ccl::LevelData::LinkTable::build(const std::vector<Item>& items,
+                                      KeyFunc key, ValueFunc value)
 {
-    std::list<ccl::Point> result;
-    std::list<ccl::Trap>::const_iterator iter = m_traps.begin();
-    while (iter != m_traps.end()) {
-        if (iter->button.X == x && iter->button.Y == y)
-            result.push_back(iter->trap);
-        ++iter;
+    // Counting sort by cell, which keeps items in list order within a cell.
+    // Out-of-range points can't be looked up, so they are left out.
+    auto cellOf = [&key](const Item& item) -> int {
+        const ccl::Point point = key(item);
+        if (point.X < 0 || point.X >= CCL_WIDTH || point.Y < 0 || point.Y >= CCL_HEIGHT)
+            return -1;
+        return (point.Y * CCL_WIDTH) + point.X;
+    };
+
+    memset(start, 0, sizeof(start));
+    for (const Item& item : items) {
+        const int cell = cellOf(item);
+        if (cell >= 0)
+            ++start[cell + 1];
+    }
+    for (int cell = 0; cell < CCL_WIDTH * CCL_HEIGHT; ++cell)
+        start[cell + 1] += start[cell];
+
+    uint16_t next[CCL_WIDTH * CCL_HEIGHT];
+    memcpy(next, start, sizeof(next));
+    points.resize(start[CCL_WIDTH * CCL_HEIGHT]);
+    for (const Item& item : items) {
+        const int cell = cellOf(item);
+        if (cell >= 0)
+            points[next[cell]++] = value(item);
     }
-    return result;
 }
 
-std::list<ccl::Point> ccl::LevelData::linkedTrapButtons(int x, int y) const
+ccl::PointView ccl::LevelData::LinkTable::at(int x, int y) const
 {
-    std::list<ccl::Point> result;
-    std::list<ccl::Trap>::const_iterator iter = m_traps.begin();
-    while (iter != m_traps.end()) {
-        if (iter->trap.X == x && iter->trap.Y == y)
-            result.push_back(iter->button);
-        ++iter;
-    }
-    return result;
+    if (x < 0 || x >= CCL_WIDTH || y < 0 || y >= CCL_HEIGHT)
+        return ccl::PointView();
+    const int cell = (y * CCL_WIDTH) + x;
+    return ccl::PointView(points.data() + start[cell], points.data() + start[cell + 1]);
 }
 
-std::list<ccl::Point> ccl::LevelData::linkedCloners(int x, int y) const
+const ccl::LevelData::LinkIndex& ccl::LevelData::links() const
 {
-    std::list<ccl::Point> result;
-    std::list<ccl::Clone>::const_iterator iter = m_clones.begin();
-    while (iter != m_clones.end()) {
-        if (iter->button.X == x && iter->button.Y == y)
-            result.push_back(iter->clone);
-        ++iter;
+    if (!m_links)
+        m_links.reset(new LinkIndex);
+    if (m_linksValid)
+        return *m_links;
+
+    LinkIndex& links = *m_links;
+    links.trapsByButton.build(m_traps, [](const ccl::Trap& trap) { return trap.button; },
+                              [](const ccl::Trap& trap) { return trap.trap; });
+    links.buttonsByTrap.build(m_traps, [](const ccl::Trap& trap) { return trap.trap; },
+                              [](const ccl::Trap& trap) { return trap.button; });
+    links.clonersByButton.build(m_clones, [](const ccl::Clone& clone) { return clone.button; },
+                                [](const ccl::Clone& clone) { return clone.clone; });
+    links.buttonsByCloner.build(m_clones, [](const ccl::Clone& clone) { return clone.clone; },
+                                [](const ccl::Clone& clone) { return clone.button; });
+
+    memset(links.movers, 0, sizeof(links.movers));
+    for (const ccl::Point& mover : m_moveList) {
+        if (mover.X < 0 || mover.X >= CCL_WIDTH || mover.Y < 0 || mover.Y >= CCL_HEIGHT)
+            continue;
+        const int cell = (mover.Y * CCL_WIDTH) + mover.X;
+        links.movers[cell / 32] |= 1u << (cell % 32);
     }
-    return result;
+
+    m_linksValid = true;
+    return links;
 }
 
-std::list<ccl::Point> ccl::LevelData::linkedCloneButtons(int x, int y) const
+ccl::PointView ccl::LevelData::linkedTraps(int x, int y) const
 {
-    std::list<ccl::Point> result;
-    std::list<ccl::Clone>::const_iterator iter = m_clones.begin();
-    while (iter != m_clones.end()) {
-        if (iter->clone.X == x && iter->clone.Y == y)
-            result.push_back(iter->button);
-        ++iter;
-    }
-    return result;
+    return links().trapsByButton.at(x, y);
+}
+
+ccl::PointView ccl::LevelData::linkedTrapButtons(int x, int y) const
+{
+    return links().buttonsByTrap.at(x, y);
+}
+
+ccl::PointView ccl::LevelData::linkedCloners(int x, int y) const
+{
+    return links().clonersByButton.at(x, y);
+}
+
+ccl::PointView ccl::LevelData::linkedCloneButtons(int x, int y) const
+{
+    return links().buttonsByCloner.at(x, y);
 }
 
 bool ccl::LevelData::checkMove(int x, int y) const
 {
-    std::list<ccl::Point>::const_iterator iter = m_moveList.begin();
-    while (iter != m_moveList.end()) {
-        if (iter->X == x && iter->Y == y)
-            return true;
-        ++iter;
-    }
-    return false;
+    if (x < 0 || x >= CCL_WIDTH || y < 0 || y >= CCL_HEIGHT)
+        return false;
+    const int cell = (y * CCL_WIDTH) + x;
+    return (links().movers[cell / 32] & (1u << (cell % 32))) != 0;
 }
 
 void ccl::LevelData::trapConnect(int buttonX, int buttonY, int trapX, int trapY)
 {
-    std::list<ccl::Trap>::iterator iter = m_traps.begin();
-    while (iter != m_traps.end()) {
-        if (iter->button.X == buttonX && iter->button.Y == buttonY
-            && iter->trap.X == trapX && iter->trap.Y == trapY)
+    for (const ccl::Trap& trap : m_traps) {
+        if (trap.button.X == buttonX && trap.button.Y == buttonY
+            && trap.trap.X == trapX && trap.trap.Y == trapY)
             return;
-        else
-            ++iter;
     }
 
     ccl::Trap item;
@@ -202,17 +280,15 @@ void ccl::LevelData::trapConnect(int buttonX, int buttonY, int trapX, int trapY)
     item.trap.X = trapX;
     item.trap.Y = trapY;
     m_traps.push_back(item);
+    listsChanged();
 }
 
 void ccl::LevelData::cloneConnect(int buttonX, int buttonY, int cloneX, int cloneY)
 {
-    std::list<ccl::Clone>::iterator iter = m_clones.begin();
-    while (iter != m_clones.end()) {
-        if (iter->button.X == buttonX && iter->button.Y == buttonY
-            && iter->clone.X == cloneX && iter->clone.Y == cloneY)
+    for (const ccl::Clone& clone : m_clones) {
+        if (clone.button.X == buttonX && clone.button.Y == buttonY
+            && clone.clone.X == cloneX && clone.clone.Y == cloneY)
             return;
-        else
-            ++iter;
     }
 
     ccl::Clone item;
@@ -221,28 +297,34 @@ void ccl::LevelData::cloneConnect(int buttonX, int buttonY, int cloneX, int clon
     item.clone.X = cloneX;
     item.clone.Y = cloneY;
     m_clones.push_back(item);
+    listsChanged();
 }
 
 void ccl::LevelData::addMover(int moverX, int moverY)
 {
-    std::list<ccl::Point>::iterator iter = m_moveList.begin();
-    while (iter != m_moveList.end()) {
-        if (iter->X == moverX && iter->Y == moverY)
+    for (const ccl::Point& mover : m_moveList) {
+        if (mover.X == moverX && mover.Y == moverY)
             return;
-        else
-            ++iter;
     }
 
     ccl::Point item;
     item.X = moverX;
     item.Y = moverY;
     m_moveList.push_back(item);
+    listsChanged();
 }
 
 long ccl::LevelData::read(ccl::Stream* stream, bool forClipboard)
 {
     long levelBegin = stream->tell();
     long dataSize = forClipboard ? 0 : (long)stream->read16();
+    listsChanged();
+
+    // The record just read is kept verbatim as the cached encoding, so an
+    // unchanged level is written back byte for byte: field order, trap
+    // state words and the RLE runs are preserved rather than re-encoded.
+    // Records that saving is expected to repair or normalize are not kept.
+    bool verbatim = !forClipboard;
 
     m_levelNum = stream->read16();
     m_timer = stream->read16();
@@ -253,6 +335,8 @@ long ccl::LevelData::read(ccl::Stream* stream, bool forClipboard)
 
     if (compressionType != 0 && compressionType != 1)
         throw ccl::IOError(ccl::RuntimeError::tr("Invalid map data field"));
+    if (compressionType != 1)
+        verbatim = false;
     dataSize -= m_map.read(stream) + sizeof(unsigned short);
 
     dataSize -= sizeof(unsigned short);
@@ -263,6 +347,7 @@ long ccl::LevelData::read(ccl::Stream* stream, bool forClipboard)
         if (fieldSize != dataSize) {
             fprintf(stderr, "Warning: Ignoring invalid field data size: %ld (expected %ld)\n",
                     fieldSize, dataSize);
+            verbatim = false;
         }
     }
 
@@ -272,6 +357,8 @@ long ccl::LevelData::read(ccl::Stream* stream, bool forClipboard)
         dataSize -= size + 2 * sizeof(unsigned char);
         if (dataSize < 0)
             throw ccl::IOError(ccl::RuntimeError::tr("Invalid or corrupt level data"));
+        if (!isVerbatimField(field))
+            verbatim = false;
 
         switch (field) {
         case FieldTimeLimit:
@@ -342,14 +429,100 @@ long ccl::LevelData::read(ccl::Stream* stream, bool forClipboard)
     if (dataSize != 0)
         throw ccl::IOError(forClipboard ? ccl::RuntimeError::tr("Corrupt level data")
                     : ccl::RuntimeError::tr("Invalid level checksum"));
-    return stream->tell() - levelBegin;
+
+    const long levelEnd = stream->tell();
+    if (verbatim) {
+        const size_t recordSize = (size_t)(levelEnd - levelBegin);
+        const uint8_t* record = stream->buffer();
+        if (record) {
+            m_encoded.assign(record + levelBegin, record + levelEnd);
+        } else {
+            m_encoded.resize(recordSize);
+            stream->seek(levelBegin, SEEK_SET);
+            if (stream->read(m_encoded.data(), 1, recordSize) != recordSize)
+                throw ccl::IOError(ccl::RuntimeError::tr("Read past end of stream"));
+        }
+        m_dirty = false;
+        m_encodedRevision = m_map.revision();
+    }
+    return levelEnd - levelBegin;
 }
 
-long ccl::LevelData::write(ccl::Stream* stream, bool forClipboard) const
+bool ccl::LevelData::isVerbatimField(unsigned char field)
 {
-    long levelBegin = stream->tell();
+    // Writing the level folds these into the header or stores them in
+    // another form, so records using them are upgraded when saved
+    return field != FieldTimeLimit && field != FieldChips
+        && field != FieldPlainPassword;
+}
+
+long ccl::LevelData::fieldsSize() const
+{
+    // Each field has a 1-byte type and a 1-byte size, followed by its data
+    long size = 0;
+    if (!m_name.empty())
+        size += 2 + (long)m_name.size() + 1;
+    if (!m_hint.empty())
+        size += 2 + (long)m_hint.size() + 1;
+    if (!m_password.empty())
+        size += 2 + (long)m_password.size() + 1;
+    if (m_traps.size() > 0)
+        size += 2 + (long)m_traps.size() * 10;
+    if (m_clones.size() > 0)
+        size += 2 + (long)m_clones.size() * 8;
+    if (m_moveList.size() > 0)
+        size += 2 + (long)m_moveList.size() * 2;
+    if (!m_author.empty())
+        size += 2 + (long)m_author.size() + 1;
+    return size;
+}
+
+long ccl::LevelData::encodedSize(bool forClipboard) const
+{
+    if (!isDirty()) {
+        const long size = (long)m_encoded.size();
+        return forClipboard ? size - (long)sizeof(uint16_t) : size;
+    }
+
+    // Level number, timer, chips, map compression type, map data,
+    // field size and fields
+    long size = 4 * sizeof(uint16_t) + m_map.encodedSize()
+              + sizeof(uint16_t) + fieldsSize();
     if (!forClipboard)
-        stream->write16(0); // This will be updated at the end
+        size += sizeof(uint16_t);
+    return size;
+}
+
+long ccl::LevelData::write(ccl::Stream* stream, bool forClipboard) const
+{
+    if (isDirty()) {
+        ccl::BufferStream buffer;
+        encode(&buffer);
+        m_encoded.assign(buffer.buffer(), buffer.buffer() + buffer.size());
+        m_dirty = false;
+        m_encodedRevision = m_map.revision();
+    }
+
+    // The level number may have changed since the record was encoded
+    m_encoded[2] = (uint8_t)(m_levelNum & 0xFF);
+    m_encoded[3] = (uint8_t)((m_levelNum >> 8) & 0xFF);
+
+    // The clipboard format is the same, just without the size prefix
+    const size_t skip = forClipboard ? sizeof(uint16_t) : 0;
+    const size_t size = m_encoded.size() - skip;
+    if (stream->write(m_encoded.data() + skip, 1, size) != size)
+        throw ccl::IOError(ccl::RuntimeError::tr("Error writing to stream"));
+    return (long)size;
+}
+
+void ccl::LevelData::encode(ccl::Stream* stream) const
+{
+    // All sizes are computed up front, so the data can be written in a
+    // single forward pass.  This allows writing to non-seekable streams.
+    const long fieldSize = fieldsSize();
+    const long levelSize = encodedSize(true);
+
+    stream->write16((uint16_t)levelSize);
 
     stream->write16(m_levelNum);
     stream->write16(m_timer);
@@ -359,8 +532,7 @@ long ccl::LevelData::write(ccl::Stream* stream, bool forClipboard) const
     stream->write16(1);
     m_map.write(stream);
 
-    long fieldBegin = stream->tell();
-    stream->write16(0); // This will be updated at the end
+    stream->write16((uint16_t)fieldSize);
 
     if (!m_name.empty()) {
         stream->write8((uint8_t)FieldName);
@@ -380,7 +552,7 @@ long ccl::LevelData::write(ccl::Stream* stream, bool forClipboard) const
     if (m_traps.size() > 0) {
         stream->write8((uint8_t)FieldTraps);
         stream->write8((uint8_t)(m_traps.size() * 10));
-        std::list<ccl::Trap>::const_iterator it;
+        std::vector<ccl::Trap>::const_iterator it;
         for (it = m_traps.begin(); it != m_traps.end(); ++it) {
             stream->write16(it->button.X);
             stream->write16(it->button.Y);
@@ -392,7 +564,7 @@ long ccl::LevelData::write(ccl::Stream* stream, bool forClipboard) const
     if (m_clones.size() > 0) {
         stream->write8((uint8_t)FieldClones);
         stream->write8((uint8_t)(m_clones.size() * 8));
-        std::list<ccl::Clone>::const_iterator it;
+        std::vector<ccl::Clone>::const_iterator it;
         for (it = m_clones.begin(); it != m_clones.end(); ++it) {
             stream->write16(it->button.X);
             stream->write16(it->button.Y);
@@ -403,7 +575,7 @@ long ccl::LevelData::write(ccl::Stream* stream, bool forClipboard) const
     if (m_moveList.size() > 0) {
         stream->write8((uint8_t)FieldMoveList);
         stream->write8((uint8_t)(m_moveList.size() * 2));
-        std::list<ccl::Point>::const_iterator it;
+        std::vector<ccl::Point>::const_iterator it;
         for (it = m_moveList.begin(); it != m_moveList.end(); ++it) {
             stream->write8(it->X);
             stream->write8(it->Y);
@@ -414,17 +586,6 @@ long ccl::LevelData::write(ccl::Stream* stream, bool forClipboard) const
         stream->write8((uint8_t)(m_author.size() + 1));
         stream->writeString(m_author);
     }
-
-    // Update checksums
-    long levelEnd = stream->tell();
-    if (!forClipboard) {
-        stream->seek(levelBegin, SEEK_SET);
-        stream->write16((uint16_t)(levelEnd - levelBegin - sizeof(unsigned short)));
-    }
-    stream->seek(fieldBegin, SEEK_SET);
-    stream->write16((uint16_t)(levelEnd - fieldBegin - sizeof(unsigned short)));
-    stream->seek(levelEnd, SEEK_SET);
-    return levelEnd - levelBegin;
 }
 
 
@@ -442,10 +603,13 @@ ccl::Levelset::Levelset(int levelCount)
 }
 
 ccl::Levelset::Levelset(const ccl::Levelset& init)
-    : m_magic(init.m_magic)
+    : m_index(init.m_index), m_lazyData(init.m_lazyData), m_magic(init.m_magic),
+      m_decoded(init.m_decoded.size(), nullptr)
 {
     m_levels.resize(init.m_levels.size());
     for (size_t i=0; i<m_levels.size(); ++i) {
+        if (!init.m_levels[i])
+            continue;
         m_levels[i] = new ccl::LevelData;
         m_levels[i]->copyFrom(init.m_levels[i]);
     }
@@ -453,8 +617,14 @@ ccl::Levelset::Levelset(const ccl::Levelset& init)
 
 ccl::Levelset::~Levelset()
 {
-    for (LevelData* level : m_levels)
-        level->unref();
+    for (LevelData* level : m_levels) {
+        if (level)
+            level->unref();
+    }
+    for (LevelData* level : m_decoded) {
+        if (level)
+            level->unref();
+    }
 }
 
 std::string ccl::Levelset::RandomPassword()
@@ -471,6 +641,8 @@ ccl::LevelData* ccl::Levelset::addLevel()
     char nameBuf[32];
     auto level = new ccl::LevelData();
     m_levels.push_back(level);
+    if (!m_index.empty())
+        m_index.emplace_back();
 
     snprintf(nameBuf, 32, "Level %d", (int)m_levels.size());
     level->setName(nameBuf);
@@ -481,25 +653,164 @@ ccl::LevelData* ccl::Levelset::addLevel()
 void ccl::Levelset::addLevel(ccl::LevelData* level)
 {
     m_levels.push_back(level);
+    if (!m_index.empty())
+        m_index.emplace_back();
 }
 
 void ccl::Levelset::insertLevel(int where, ccl::LevelData* level)
 {
     m_levels.insert(m_levels.begin() + where, level);
+    if (!m_index.empty())
+        m_index.emplace(m_index.begin() + where);
 }
 
 ccl::LevelData* ccl::Levelset::takeLevel(int num)
 {
-    ccl::LevelData* level = m_levels[num];
+    ccl::LevelData* level = this->level(num);
     m_levels.erase(m_levels.begin() + num);
+    if (!m_index.empty())
+        m_index.erase(m_index.begin() + num);
     return level;
 }
 
-void ccl::Levelset::read(ccl::Stream* stream)
+int ccl::Levelset::indexOf(const ccl::LevelData* level) const
 {
-    for (ccl::LevelData* level : m_levels)
+    auto iter = std::find(m_levels.begin(), m_levels.end(), level);
+    if (!level || iter == m_levels.end())
+        return -1;
+    return (int)(iter - m_levels.begin());
+}
+
+std::string ccl::Levelset::levelName(int num) const
+{
+    const ccl::LevelData* level = m_levels[(size_t)num];
+    return level ? level->name() : m_index[(size_t)num].name;
+}
+
+std::string ccl::Levelset::levelPassword(int num) const
+{
+    const ccl::LevelData* level = m_levels[(size_t)num];
+    return level ? level->password() : m_index[(size_t)num].password;
+}
+
+unsigned short ccl::Levelset::levelTimer(int num) const
+{
+    const ccl::LevelData* level = m_levels[(size_t)num];
+    return level ? level->timer() : m_index[(size_t)num].timer;
+}
+
+void ccl::Levelset::saveLevelList(LevelList* list) const
+{
+    list->assign(m_levels);
+    for (ccl::LevelData* level : list->m_levels) {
+        if (level)
+            level->ref();
+    }
+    list->m_index = m_index;
+}
+
+void ccl::Levelset::restoreLevelList(const LevelList& list)
+{
+    for (ccl::LevelData* level : m_levels) {
+        if (level)
+            level->unref();
+    }
+    m_levels = list.m_levels;
+    m_index = list.m_index;
+
+    for (size_t i = 0; i < m_levels.size(); ++i) {
+        // Pick up levels decoded since the list was saved
+        if (!m_levels[i])
+            m_levels[i] = m_decoded[m_index[i].record];
+        if (m_levels[i])
+            m_levels[i]->ref();
+    }
+}
+
+ccl::Levelset::LevelList::~LevelList()
+{
+    assign(std::vector<ccl::LevelData*>());
+}
+
+void ccl::Levelset::LevelList::assign(std::vector<ccl::LevelData*> levels)
+{
+    for (ccl::LevelData* level : m_levels) {
+        if (level)
+            level->unref();
+    }
+    m_levels = std::move(levels);
+    m_index.clear();
+}
+
+/* Calls func(i) for each i in [0, count) across up to threads workers.
+ * If any call throws, the exception from the lowest index is rethrown
+ * once all workers are done, so errors match those of a serial loop. */
+template <typename Func>
+static void parallelFor(size_t count, unsigned int threads, Func func)
+{
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = (unsigned int)std::min<size_t>(threads, count);
+
+    std::atomic<size_t> next(0);
+    std::mutex errorMutex;
+    std::exception_ptr error;
+    size_t errorIndex = count;
+    auto worker = [&]() {
+        for ( ;; ) {
+            const size_t i = next++;
+            if (i >= count)
+                return;
+            try {
+                func(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (i < errorIndex) {
+                    errorIndex = i;
+                    error = std::current_exception();
+                }
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned int t = 1; t < threads; ++t)
+        pool.emplace_back(worker);
+    worker();
+    for (std::thread& thread : pool)
+        thread.join();
+
+    if (error)
+        std::rethrow_exception(error);
+}
+
+static ccl::LevelData* decodeRecord(const uint8_t* data, size_t size)
+{
+    ccl::MemoryStream stream(data, size);
+    auto level = new ccl::LevelData;
+    try {
+        level->read(&stream);
+    } catch (...) {
         level->unref();
+        throw;
+    }
+    return level;
+}
+
+void ccl::Levelset::read(ccl::Stream* stream, bool lazy, unsigned int threads)
+{
+    for (ccl::LevelData* level : m_levels) {
+        if (level)
+            level->unref();
+    }
     m_levels.resize(0);
+    m_index.clear();
+    m_lazyData.clear();
+    for (ccl::LevelData* level : m_decoded) {
+        if (level)
+            level->unref();
+    }
+    m_decoded.clear();
 
     m_magic = stream->read32();
     if (m_magic != TypeMS && m_magic != TypeLynx && m_magic != TypePG
@@ -507,24 +818,252 @@ void ccl::Levelset::read(ccl::Stream* stream)
         throw ccl::IOError(ccl::RuntimeError::tr("Invalid levelset header"));
 
     uint16_t numLevels = stream->read16();
-    m_levels.reserve(numLevels);
-    for (uint16_t i = 0; i < numLevels; ++i) {
-        m_levels.push_back(new ccl::LevelData);
-        m_levels.back()->read(stream);
+    if (!lazy && threads == 1) {
+        m_levels.reserve(numLevels);
+        for (uint16_t i = 0; i < numLevels; ++i) {
+            m_levels.push_back(new ccl::LevelData);
+            m_levels.back()->read(stream);
+        }
+        return;
+    }
+
+    // Memory-backed streams can be parsed in place, unless the data needs
+    // to be kept around for lazy decoding
+    const long dataBegin = stream->tell();
+    std::vector<uint8_t> dataCopy;
+    const uint8_t* data = stream->buffer();
+    size_t dataSize = (size_t)std::max(0L, stream->size() - dataBegin);
+    if (data && !lazy) {
+        data += dataBegin;
+    } else {
+        dataCopy.resize(dataSize);
+        dataSize = stream->read(dataCopy.data(), 1, dataSize);
+        data = dataCopy.data();
+    }
+
+    // A valid record is always exactly as long as its size prefix says, so
+    // the records can be located up front and then parsed independently.
+    // Each one is parsed from its start through the end of the data, so a
+    // bad record fails exactly the way it would in a serial read.
+    std::vector<size_t> offsets(numLevels);
+    size_t offset = 0;
+    for (size_t& levelOffset : offsets) {
+        levelOffset = offset;
+        if (dataSize - offset < sizeof(uint16_t)) {
+            offset = dataSize;
+            continue;
+        }
+        const size_t size = sizeof(uint16_t) + (data[offset] | (data[offset + 1] << 8));
+        offset = std::min(offset + size, dataSize);
+    }
+
+    try {
+        if (lazy) {
+            // Keep a copy of the raw level records, and just index them for
+            // now.  Each record is still fully validated, so errors are
+            // reported here rather than when the level is first accessed.
+            m_lazyData = std::move(dataCopy);
+            m_index.resize(numLevels);
+            parallelFor(numLevels, threads, [&](size_t i) {
+                m_index[i] = indexLevel(offsets[i], m_lazyData.size() - offsets[i]);
+                m_index[i].record = i;
+            });
+            m_levels.resize(numLevels, nullptr);
+            m_decoded.resize(numLevels, nullptr);
+        } else {
+            m_levels.resize(numLevels, nullptr);
+            parallelFor(numLevels, threads, [&](size_t i) {
+                m_levels[i] = decodeRecord(data + offsets[i], dataSize - offsets[i]);
+            });
+        }
+    } catch (...) {
+        for (ccl::LevelData* level : m_levels) {
+            if (level)
+                level->unref();
+        }
+        m_levels.resize(0);
+        m_index.clear();
+        m_lazyData.clear();
+        throw;
     }
+
+    // Leave the stream just past the levelset data, like a serial read
+    stream->seek(dataBegin + (long)offset, SEEK_SET);
 }
 
-void ccl::Levelset::write(ccl::Stream* stream) const
+ccl::Levelset::LevelIndex ccl::Levelset::indexLevel(size_t offset, size_t dataSize) const
 {
-    stream->write32(m_magic);
-    stream->write16((uint16_t)m_levels.size());
+    // This mirrors the checks in LevelData::read(), but only keeps the
+    // data shown in level lists
+    const uint8_t* const data = m_lazyData.data() + offset;
+    size_t pos = 0;
 
-    int levelNum = 0;
-    for (ccl::LevelData* level : m_levels) {
-        // Re-set level number in case levels were re-ordered
-        level->setLevelNum(++levelNum);
-        level->write(stream);
+    auto need = [&](size_t count) {
+        if (dataSize - pos < count)
+            throw ccl::IOError(ccl::RuntimeError::tr("Read past end of stream"));
+    };
+    auto get16 = [&]() -> uint16_t {
+        need(sizeof(uint16_t));
+        const uint16_t value = (uint16_t)(data[pos] | (data[pos + 1] << 8));
+        pos += sizeof(uint16_t);
+        return value;
+    };
+    auto getString = [&](size_t length, bool password) -> std::string {
+        if (length == 0)
+            return std::string();
+        std::string value(reinterpret_cast<const char*>(data + pos), length - 1);
+        if (password) {
+            for (char& ch : value)
+                ch ^= 0x99;
+        }
+        return value;
+    };
+
+    LevelIndex index;
+    index.offset = offset;
+    index.verbatim = true;
+
+    long dataLeft = (long)get16();
+    (void)get16();      // Level number
+    index.timer = get16();
+    (void)get16();      // Chips
+    dataLeft -= 3 * sizeof(unsigned short);
+
+    uint16_t compressionType = get16();
+    if (compressionType != 0 && compressionType != 1)
+        throw ccl::IOError(ccl::RuntimeError::tr("Invalid map data field"));
+    if (compressionType != 1)
+        index.verbatim = false;
+
+    tile_t scratch[CCL_WIDTH * CCL_HEIGHT];
+    size_t mapSize = ccl::Stream::decodeRLE(scratch, CCL_WIDTH * CCL_HEIGHT,
+                                            data + pos, dataSize - pos);
+    mapSize += ccl::Stream::decodeRLE(scratch, CCL_WIDTH * CCL_HEIGHT,
+                                      data + pos + mapSize, dataSize - pos - mapSize);
+    pos += mapSize;
+    dataLeft -= (long)mapSize + sizeof(unsigned short);
+
+    dataLeft -= sizeof(unsigned short);
+    long fieldSize = (long)get16();
+    if (fieldSize != dataLeft) {
+        fprintf(stderr, "Warning: Ignoring invalid field data size: %ld (expected %ld)\n",
+                fieldSize, dataLeft);
+        index.verbatim = false;
     }
+
+    while (dataLeft > 0) {
+        need(2);
+        const unsigned char field = data[pos++];
+        const unsigned char size = data[pos++];
+        dataLeft -= size + 2 * sizeof(unsigned char);
+        if (dataLeft < 0)
+            throw ccl::IOError(ccl::RuntimeError::tr("Invalid or corrupt level data"));
+        need(size);
+        if (!LevelData::isVerbatimField(field))
+            index.verbatim = false;
+
+        switch (field) {
+        case LevelData::FieldTimeLimit:
+            if (size != sizeof(uint16_t))
+                throw ccl::IOError(ccl::RuntimeError::tr("Invalid time limit field size"));
+            index.timer = (unsigned short)(data[pos] | (data[pos + 1] << 8));
+            break;
+        case LevelData::FieldChips:
+            if (size != sizeof(uint16_t))
+                throw ccl::IOError(ccl::RuntimeError::tr("Invalid chips field size"));
+            break;
+        case LevelData::FieldName:
+            index.name = getString(size, false);
+            break;
+        case LevelData::FieldPassword:
+            index.password = getString(size, true);
+            break;
+        case LevelData::FieldPlainPassword:
+            index.password = getString(size, false);
+            break;
+        case LevelData::FieldHint:
+        case LevelData::FieldAuthor_EXT:
+            break;
+        case LevelData::FieldTraps:
+            if ((size % 10) != 0)
+                throw ccl::IOError(ccl::RuntimeError::tr("Invalid trap field size"));
+            break;
+        case LevelData::FieldClones:
+            if ((size % 8) != 0)
+                throw ccl::IOError(ccl::RuntimeError::tr("Invalid clone field size"));
+            break;
+        case LevelData::FieldMoveList:
+            if ((size % 2) != 0)
+                throw ccl::IOError(ccl::RuntimeError::tr("Invalid move list field size"));
+            break;
+        default:
+            throw ccl::IOError(ccl::RuntimeError::tr("Invalid / unrecognized field type"));
+        }
+        pos += size;
+    }
+
+    if (dataLeft != 0)
+        throw ccl::IOError(ccl::RuntimeError::tr("Invalid level checksum"));
+
+    index.size = pos;
+    return index;
+}
+
+ccl::LevelData* ccl::Levelset::decodeLevel(int num) const
+{
+    const LevelIndex& index = m_index[(size_t)num];
+    ccl::LevelData* level = decodeRecord(&m_lazyData[index.offset], index.size);
+    level->ref();
+    m_decoded[index.record] = level;
+    return level;
+}
+
+void ccl::Levelset::writeLevel(ccl::Stream* stream, int num) const
+{
+    const LevelIndex* index = m_levels[(size_t)num] ? nullptr : &m_index[(size_t)num];
+    if (index && index->verbatim) {
+        // Levels that were never accessed are passed through byte for
+        // byte from their original record, with only the level number
+        // patched in.  This is the same verbatim record LevelData::read()
+        // would cache, not a re-encoding of the level.
+        const uint8_t* record = &m_lazyData[index->offset];
+        const size_t rest = index->size - 2 * sizeof(uint16_t);
+        stream->write16((uint16_t)(record[0] | (record[1] << 8)));
+        stream->write16((uint16_t)(num + 1));
+        if (stream->write(record + 2 * sizeof(uint16_t), 1, rest) != rest)
+            throw ccl::IOError(ccl::RuntimeError::tr("Error writing to stream"));
+        return;
+    }
+
+    ccl::LevelData* level = this->level(num);
+    // Re-set level number in case levels were re-ordered
+    level->setLevelNum(num + 1);
+    level->write(stream);
+}
+
+void ccl::Levelset::write(ccl::Stream* stream, unsigned int threads) const
+{
+    // Serialize to memory first, so the output only sees a single write
+    ccl::BufferStream buffer;
+    buffer.write32(m_magic);
+    buffer.write16((uint16_t)m_levels.size());
+
+    if (threads == 1) {
+        for (int i = 0; i < levelCount(); ++i)
+            writeLevel(&buffer, i);
+    } else {
+        // Encode each level into its own buffer, then join them in order
+        std::vector<ccl::BufferStream> records(m_levels.size());
+        parallelFor(records.size(), threads, [&](size_t i) {
+            writeLevel(&records[i], (int)i);
+        });
+        for (ccl::BufferStream& record : records)
+            buffer.write(record.buffer(), 1, (size_t)record.size());
+    }
+
+    const size_t size = (size_t)buffer.size();
+    if (stream->write(buffer.buffer(), 1, size) != size)
+        throw ccl::IOError(ccl::RuntimeError::tr("Error writing to stream"));
 }
 
 
@@ -533,12 +1072,20 @@ ccl::LevelsetType ccl::DetermineLevelsetType(const QString& filename)
     ccl::FileStream stream;
     if (!stream.open(filename, ccl::FileStream::Read))
         return LevelsetError;
+    return DetermineLevelsetType(&stream);
+}
 
+ccl::LevelsetType ccl::DetermineLevelsetType(ccl::Stream* stream)
+{
+    // Peek at the header without disturbing the stream position, so the
+    // same stream can be handed to Levelset::read() afterward
+    long start = stream->tell();
     uint32_t magic;
-    size_t count = stream.read(&magic, sizeof(uint32_t), 1);
-    stream.close();
+    size_t count = stream->read(&magic, sizeof(uint32_t), 1);
+    stream->seek(start, SEEK_SET);
     if (count == 0)
         return LevelsetError;
+    magic = SWAP32(magic);
     if (magic == Levelset::TypeLynx || magic == Levelset::TypeMS
         || magic == Levelset::TypePG || magic == Levelset::TypeLynxPG)
         return LevelsetCcl;
@@ -557,17 +1104,9 @@ void ccl::ClipboardData::read(Stream* stream)
 
 void ccl::ClipboardData::write(Stream* stream) const
 {
-    // We only support writing to the beginning of seekable streams for now
-    if (stream->tell() != 0L) {
-        throw ccl::RuntimeError(ccl::RuntimeError::tr(
-                "Cannot write clipboard data to the middle of a stream"));
-    }
-
     stream->write32(m_width);
     stream->write32(m_height);
-    stream->write16(0);    // Revisit after writing data
+    stream->write16((uint16_t)m_levelData->encodedSize(true));  // Size of data buffer
     stream->write32(0);
     m_levelData->write(stream, true);
-    stream->seek(8, SEEK_SET);
-    stream->write16(stream->size() - 14); // Size of data buffer
 }
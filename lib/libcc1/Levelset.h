@@ -19,10 +19,11 @@
 #define _LEVELSET_H
 
 #include <string>
-#include <list>
 #include <vector>
+#include <memory>
 #include <cstdio>
 #include "Stream.h"
+#include "TileMask.h"
 
 #define CCL_WIDTH   32
 #define CCL_HEIGHT  32
@@ -42,10 +43,33 @@ struct Point {
 struct Trap     { Point button, trap; };
 struct Clone    { Point button, clone; };
 
+/* Read-only view of a run of points owned by a LevelData.  Views are only
+ * valid until the level's connections or move list are next modified. */
+class PointView {
+public:
+    typedef const Point* const_iterator;
+
+    PointView() : m_begin(), m_end() { }
+    PointView(const Point* begin, const Point* end) : m_begin(begin), m_end(end) { }
+
+    const_iterator begin() const { return m_begin; }
+    const_iterator end() const { return m_end; }
+    size_t size() const { return (size_t)(m_end - m_begin); }
+    bool empty() const { return m_begin == m_end; }
+    const Point& front() const { return *m_begin; }
+    const Point& operator[](size_t index) const { return m_begin[index]; }
+
+private:
+    const Point* m_begin;
+    const Point* m_end;
+};
+
 class LevelMap {
 public:
+    enum Layers { LayerFG = 0x1, LayerBG = 0x2, LayerBoth = 0x3 };
+
     LevelMap();
-    LevelMap(const LevelMap& init) { operator=(init); }
+    LevelMap(const LevelMap& init) : m_revision() { operator=(init); }
 
     LevelMap& operator=(const LevelMap& source);
     void copyFrom(const LevelMap& source, int srcX = 0, int srcY = 0,
@@ -55,20 +79,44 @@ public:
     tile_t getFG(int x, int y) const { return m_fgTiles[(CCL_WIDTH*y) + x]; }
     tile_t getBG(int x, int y) const { return m_bgTiles[(CCL_WIDTH*y) + x]; }
 
-    void setFG(int x, int y, tile_t tile) { m_fgTiles[(CCL_WIDTH*y) + x] = tile; }
-    void setBG(int x, int y, tile_t tile) { m_bgTiles[(CCL_WIDTH*y) + x] = tile; }
+    void setFG(int x, int y, tile_t tile)
+    {
+        m_fgTiles[(CCL_WIDTH*y) + x] = tile;
+        ++m_revision;
+    }
+
+    void setBG(int x, int y, tile_t tile)
+    {
+        m_bgTiles[(CCL_WIDTH*y) + x] = tile;
+        ++m_revision;
+    }
 
     void push(int x, int y, tile_t tile);
     tile_t pop(int x, int y);
 
     long read(Stream* stream);
     long write(Stream* stream) const;
+    long encodedSize() const;
 
     ccl::Point findNext(int x, int y, tile_t tile) const;
 
+    // Cells on the given layers containing a tile in [first, last]
+    ccl::TileMask findTiles(tile_t first, tile_t last, Layers layers = LayerBoth) const;
+    ccl::TileMask findTiles(tile_t tile, Layers layers = LayerBoth) const
+    {
+        return findTiles(tile, tile, layers);
+    }
+
+    // Counts matches on the FG and BG layers separately
+    int countTiles(tile_t tile) const;
+
+    // Changes every time the map's tiles are modified
+    unsigned int revision() const { return m_revision; }
+
 private:
     tile_t m_fgTiles[CCL_WIDTH * CCL_HEIGHT];
     tile_t m_bgTiles[CCL_WIDTH * CCL_HEIGHT];
+    unsigned int m_revision;
 };
 
 
@@ -81,7 +129,9 @@ public:
     };
 
 public:
-    LevelData() : m_refs(1), m_levelNum(), m_chips(), m_timer() { }
+    LevelData()
+        : m_refs(1), m_levelNum(), m_chips(), m_timer(), m_dirty(true),
+          m_encodedRevision(), m_linksValid() { }
     LevelData(const LevelData&) = delete;
     LevelData& operator=(const LevelData&) = delete;
 
@@ -96,26 +146,32 @@ public:
     std::string author() const { return m_author; }
     unsigned short chips() const { return m_chips; }
     unsigned short timer() const { return m_timer; }
-    const std::list<ccl::Trap>& traps() const { return m_traps; }
-    const std::list<ccl::Clone>& clones() const { return m_clones; }
-    const std::list<ccl::Point>& moveList() const { return m_moveList; }
-    std::list<ccl::Trap>& traps() { return m_traps; }
-    std::list<ccl::Clone>& clones() { return m_clones; }
-    std::list<ccl::Point>& moveList() { return m_moveList; }
-
-    std::list<ccl::Point> linkedTraps(int x, int y) const;
-    std::list<ccl::Point> linkedTrapButtons(int x, int y) const;
-    std::list<ccl::Point> linkedCloners(int x, int y) const;
-    std::list<ccl::Point> linkedCloneButtons(int x, int y) const;
+    const std::vector<ccl::Trap>& traps() const { return m_traps; }
+    const std::vector<ccl::Clone>& clones() const { return m_clones; }
+    const std::vector<ccl::Point>& moveList() const { return m_moveList; }
+
+    // The lists may be modified through these, so assume they will be
+    std::vector<ccl::Trap>& traps() { listsChanged(); return m_traps; }
+    std::vector<ccl::Clone>& clones() { listsChanged(); return m_clones; }
+    std::vector<ccl::Point>& moveList() { listsChanged(); return m_moveList; }
+
+    // Connections for the tile at (x, y), in list order
+    ccl::PointView linkedTraps(int x, int y) const;
+    ccl::PointView linkedTrapButtons(int x, int y) const;
+    ccl::PointView linkedCloners(int x, int y) const;
+    ccl::PointView linkedCloneButtons(int x, int y) const;
     bool checkMove(int x, int y) const;
 
-    void setName(const std::string& name) { m_name = name; }
-    void setHint(const std::string& hint) { m_hint = hint; }
-    void setPassword(const std::string& pass) { m_password = pass; }
-    void setAuthor(const std::string& author) { m_author = author; }
+    void setName(const std::string& name) { m_name = name; m_dirty = true; }
+    void setHint(const std::string& hint) { m_hint = hint; m_dirty = true; }
+    void setPassword(const std::string& pass) { m_password = pass; m_dirty = true; }
+    void setAuthor(const std::string& author) { m_author = author; m_dirty = true; }
+    void setChips(int chips) { m_chips = chips; m_dirty = true; }
+    void setTimer(int timer) { m_timer = timer; m_dirty = true; }
+
+    // The level number is patched into the cached record on write, so
+    // renumbering levels doesn't force them to be re-encoded
     void setLevelNum(int num) { m_levelNum = num; }
-    void setChips(int chips) { m_chips = chips; }
-    void setTimer(int timer) { m_timer = timer; }
 
     void trapConnect(int buttonX, int buttonY, int trapX, int trapY);
     void cloneConnect(int buttonX, int buttonY, int cloneX, int cloneY);
@@ -123,6 +179,19 @@ public:
 
     long read(Stream* stream, bool forClipboard = false);
     long write(Stream* stream, bool forClipboard = false) const;
+    long encodedSize(bool forClipboard = false) const;
+
+    // Whether a record with this field is kept verbatim when written back
+    static bool isVerbatimField(unsigned char field);
+
+    // Whether the level has changed since it was last read or written.
+    // Clean levels are written from a cached copy of their record, which
+    // may be the original record verbatim rather than a fresh encoding.
+    bool isDirty() const
+    {
+        return m_dirty || m_map.revision() != m_encodedRevision;
+    }
+    void setDirty() { m_dirty = true; }
 
     void ref()
     {
@@ -140,6 +209,33 @@ public:
 private:
     ~LevelData() = default;
 
+    // Points grouped by the grid cell they are linked to, keeping the
+    // order of the list the table was built from
+    struct LinkTable {
+        uint16_t start[CCL_WIDTH * CCL_HEIGHT + 1];
+        std::vector<ccl::Point> points;
+
+        template <typename Item, typename KeyFunc, typename ValueFunc>
+        void build(const std::vector<Item>& items, KeyFunc key, ValueFunc value);
+        ccl::PointView at(int x, int y) const;
+    };
+
+    struct LinkIndex {
+        LinkTable trapsByButton, buttonsByTrap;
+        LinkTable clonersByButton, buttonsByCloner;
+        uint32_t movers[CCL_WIDTH * CCL_HEIGHT / 32];
+    };
+
+    long fieldsSize() const;
+    void encode(Stream* stream) const;
+
+    const LinkIndex& links() const;
+    void listsChanged()
+    {
+        m_dirty = true;
+        m_linksValid = false;
+    }
+
     int m_refs;
     ccl::LevelMap m_map;
     std::string m_name;
@@ -148,9 +244,17 @@ private:
     std::string m_author;
     int m_levelNum;
     int m_chips, m_timer;
-    std::list<ccl::Trap> m_traps;
-    std::list<ccl::Clone> m_clones;
-    std::list<ccl::Point> m_moveList;
+    std::vector<ccl::Trap> m_traps;
+    std::vector<ccl::Clone> m_clones;
+    std::vector<ccl::Point> m_moveList;
+
+    mutable bool m_dirty;
+    mutable unsigned int m_encodedRevision;
+    mutable std::vector<uint8_t> m_encoded;
+
+    // Built on first query after the lists change
+    mutable std::unique_ptr<LinkIndex> m_links;
+    mutable bool m_linksValid;
 };
 
 
@@ -173,23 +277,86 @@ public:
     unsigned int type() const { return m_magic; }
     void setType(unsigned int type) { m_magic = type; }
 
-    ccl::LevelData* level(int num) const { return m_levels[(size_t)num]; }
+    ccl::LevelData* level(int num) const
+    {
+        // Levels from a lazy read() are only decoded on first access
+        ccl::LevelData*& level = m_levels[(size_t)num];
+        if (!level)
+            level = decodeLevel(num);
+        return level;
+    }
+
     int levelCount() const { return (int)m_levels.size(); }
     ccl::LevelData* addLevel();
     void addLevel(ccl::LevelData* level);
     void insertLevel(int where, ccl::LevelData* level);
     ccl::LevelData* takeLevel(int num);
+    int indexOf(const ccl::LevelData* level) const;
 
-    void read(Stream* stream);
-    void write(Stream* stream) const;
+    // These don't force a lazily loaded level to be decoded
+    std::string levelName(int num) const;
+    std::string levelPassword(int num) const;
+    unsigned short levelTimer(int num) const;
+
+    // A copy of the level order that can be restored later, such as for
+    // undo, without decoding lazily loaded levels.  It is only valid for
+    // the levelset it was saved from, until that levelset is read again.
+    class LevelList;
+    void saveLevelList(LevelList* list) const;
+    void restoreLevelList(const LevelList& list);
+
+    // A thread count of 0 uses one worker per hardware thread.  Output
+    // and error reporting don't depend on the number of threads.
+    void read(Stream* stream, bool lazy = false, unsigned int threads = 1);
+    void write(Stream* stream, unsigned int threads = 1) const;
 
 private:
-    std::vector<ccl::LevelData*> m_levels;
+    struct LevelIndex {
+        size_t offset, size;
+        std::string name;
+        std::string password;
+        unsigned short timer;
+        bool verbatim;      // Whether the record is written back verbatim
+        size_t record;      // Position of the record in the file
+    };
+
+    // Undecoded levels are NULL, and are backed by their m_index entry
+    // and the raw level data in m_lazyData
+    mutable std::vector<ccl::LevelData*> m_levels;
+    std::vector<LevelIndex> m_index;
+    std::vector<uint8_t> m_lazyData;
     unsigned int m_magic;
+
+    // Every level decoded from a lazy record, by record.  A LevelList
+    // saved before the level was decoded restores it to this same level,
+    // so edits made to it since are kept.
+    mutable std::vector<ccl::LevelData*> m_decoded;
+
+    LevelIndex indexLevel(size_t offset, size_t dataSize) const;
+    ccl::LevelData* decodeLevel(int num) const;
+    void writeLevel(Stream* stream, int num) const;
+};
+
+class Levelset::LevelList {
+public:
+    LevelList() { }
+    ~LevelList();
+
+    LevelList(const LevelList&) = delete;
+    LevelList& operator=(const LevelList&) = delete;
+
+    // Takes over a reference to each of the levels
+    void assign(std::vector<ccl::LevelData*> levels);
+
+private:
+    friend class Levelset;
+    std::vector<ccl::LevelData*> m_levels;
+    std::vector<LevelIndex> m_index;
 };
 
 enum LevelsetType { LevelsetError, LevelsetDac, LevelsetCcl };
 LevelsetType DetermineLevelsetType(const QString& filename);
+LevelsetType DetermineLevelsetType(Stream* stream);
 
 
 class ClipboardData {
@@ -0,0 +1,135 @@
+/******************************************************************************
+ * This file is part of CCTools.                                              *
+ *                                                                            *
+ * CCTools is free software: you can redistribute it and/or modify            *
+ * it under the terms of the GNU General Public License as published by       *
+ * the Free Software Foundation, either version 3 of the License, or          *
+ * (at your option) any later version.                                        *
+ *                                                                            *
+ * CCTools is distributed in the hope that it will be useful,                 *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with CCTools.  If not, see <http://www.gnu.org/licenses/>.           *
+ ******************************************************************************/
+
+#include "Reachability.h"
+
+static bool isBlockTile(tile_t tile)
+{
+    return tile == ccl::TileBlock || tile == ccl::TileIceBlock
+        || (tile >= ccl::TileBlock_N && tile <= ccl::TileBlock_E);
+}
+
+enum { FlippersBit = 1 << 0, FireBootsBit = 1 << 1 };
+
+ccl::Reachability ccl::FindReachable(const LevelData* level)
+{
+    Reachability result;
+    const LevelMap& map = level->map();
+
+    const TileMask players = map.findTiles(TilePlayer_N, TilePlayer_E, LevelMap::LayerFG);
+    if (players.count() != 1)
+        return result;
+
+    // Creatures and blocks will move out of the way, so use the terrain
+    // underneath them
+    tile_t terrain[CCL_WIDTH * CCL_HEIGHT];
+    bool haveBlocks = false, haveMonsters = false;
+    for (int y = 0; y < CCL_HEIGHT; ++y) {
+        for (int x = 0; x < CCL_WIDTH; ++x) {
+            const tile_t fg = map.getFG(x, y);
+            if (isBlockTile(fg))
+                haveBlocks = true;
+            if (MONSTER_TILE(fg))
+                haveMonsters = true;
+            const bool mobile = MOVING_TILE(fg) || isBlockTile(fg)
+                             || (fg >= TilePlayer_N && fg <= TilePlayer_E);
+            terrain[(y * CCL_WIDTH) + x] = mobile ? map.getBG(x, y) : fg;
+        }
+    }
+
+    auto find = [&terrain](tile_t first, tile_t last) {
+        return TileMask::fromLayer(terrain, first, last);
+    };
+
+    TileMask blocked = find(TileWall, TileWall);
+    blocked |= find(TileInvisWall, TileInvisWall);
+    blocked |= find(TileBlueWall, Tile_UNUSED_20);
+    blocked |= find(TileCloner, TileCloner);
+    blocked |= find(TilePlayerSplash, Tile_UNUSED_37);
+    blocked |= find(TilePlayerExit, TilePlayerSwim_E);
+    blocked |= find(NUM_TILE_TYPES, 0xFF);
+
+    const TileMask bombs = find(TileBomb, TileBomb);
+    const TileMask water = find(TileWater, TileWater);
+    const TileMask fire = find(TileFire, TileFire);
+    const TileMask socket = find(TileSocket, TileSocket);
+    const TileMask exits = find(TileExit, TileExit);
+    const TileMask teleports = find(TileTeleport, TileTeleport);
+    const TileMask chipCells = find(TileChip, TileChip);
+    TileMask doors[4], keys[4], boots[4];
+    for (int color = 0; color < 4; ++color) {
+        doors[color] = find(TileDoor_Blue + color, TileDoor_Blue + color);
+        keys[color] = find(TileKey_Blue + color, TileKey_Blue + color);
+        boots[color] = find(TileFlippers + color, TileFlippers + color);
+    }
+
+    TileMask open = ~(blocked | bombs | water | fire | socket | doors[0]
+                      | doors[1] | doors[2] | doors[3]);
+    if (haveBlocks)
+        open |= water;
+    if (haveBlocks || haveMonsters)
+        open |= bombs;
+
+    TileMask frontier = players;
+    result.cells = players;
+    for ( ;; ) {
+        // Flood outward one step at a time.  Stepping onto the exit ends
+        // the level, so the flood doesn't continue past it.
+        while (frontier.any()) {
+            TileMask next = frontier & ~exits;
+            next = next.neighbors() & open & ~result.cells;
+            if ((next & teleports).any())
+                next |= teleports & ~result.cells;
+            result.cells |= next;
+            frontier = next;
+        }
+
+        // Anything picked up may open more of the map
+        const uint8_t oldKeys = result.keys;
+        const uint8_t oldBoots = result.boots;
+        for (int color = 0; color < 4; ++color) {
+            if ((keys[color] & result.cells).any())
+                result.keys |= 1 << color;
+            if ((boots[color] & result.cells).any())
+                result.boots |= 1 << color;
+        }
+        result.chips = (chipCells & result.cells).count();
+
+        TileMask unlocked;
+        for (int color = 0; color < 4; ++color) {
+            if (result.keys & ~oldKeys & (1 << color))
+                unlocked |= doors[color];
+        }
+        if (result.boots & ~oldBoots & FlippersBit)
+            unlocked |= water;
+        if (result.boots & ~oldBoots & FireBootsBit)
+            unlocked |= fire;
+        if (result.chips >= level->chips())
+            unlocked |= socket;
+
+        unlocked &= ~open;
+        if (!unlocked.any())
+            break;
+
+        // Newly opened cells next to the reached area restart the flood
+        open |= unlocked;
+        frontier = (result.cells & ~exits).neighbors() & unlocked & ~result.cells;
+        result.cells |= frontier;
+    }
+
+    return result;
+}
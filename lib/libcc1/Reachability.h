@@ -0,0 +1,46 @@
+/******************************************************************************
+ * This file is part of CCTools.                                              *
+ *                                                                            *
+ * CCTools is free software: you can redistribute it and/or modify            *
+ * it under the terms of the GNU General Public License as published by       *
+ * the Free Software Foundation, either version 3 of the License, or          *
+ * (at your option) any later version.                                        *
+ *                                                                            *
+ * CCTools is distributed in the hope that it will be useful,                 *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with CCTools.  If not, see <http://www.gnu.org/licenses/>.           *
+ ******************************************************************************/
+
+#ifndef _REACHABILITY_H
+#define _REACHABILITY_H
+
+#include "Levelset.h"
+
+namespace ccl {
+
+struct Reachability {
+    Reachability() : keys(), boots(), chips() { }
+
+    TileMask cells;     // Cells the player can step onto
+    uint8_t keys;       // Bit per key color in reach, in TileKey_* order
+    uint8_t boots;      // Bit per boot type in reach, TileFlippers first
+    int chips;          // Chips in reach
+};
+
+/* Finds the cells the player could reach from the start position, picking
+ * up keys and boots along the way.  The analysis is optimistic: monsters,
+ * thin walls, sliding and key counts are ignored, toggle walls count as
+ * open, any teleport may lead to any other, water counts as passable if
+ * the level has a block that could be pushed in, and so do bombs if there
+ * is a block or monster to set them off.  Cells outside the
+ * result are therefore unreachable for certain.  The result is empty
+ * unless there is exactly one player. */
+Reachability FindReachable(const LevelData* level);
+
+}
+
+#endif
@@ -0,0 +1,467 @@
+/******************************************************************************
+ * This file is part of CCTools.                                              *
+ *                                                                            *
+ * CCTools is free software: you can redistribute it and/or modify            *
+ * it under the terms of the GNU General Public License as published by       *
+ * the Free Software Foundation, either version 3 of the License, or          *
+ * (at your option) any later version.                                        *
+ *                                                                            *
+ * CCTools is distributed in the hope that it will be useful,                 *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with CCTools.  If not, see <http://www.gnu.org/licenses/>.           *
+ ******************************************************************************/
+
+#include "Solver.h"
+
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <algorithm>
+
+// Longest the player may be carried by ice or force floors before the
+// move is treated as an endless loop
+#define SOLVER_SETTLE_TICKS     (60 * ccl::GameEngine::TicksPerSecond)
+
+// Frontier entries handed to a worker at a time
+#define SOLVER_BLOCK_SIZE       256
+
+namespace {
+
+enum { NumActions = 5, ActionWait = 4 };
+
+uint64_t mix64(uint64_t value)
+{
+    // splitmix64 finalizer
+    value += 0x9E3779B97F4A7C15ULL;
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+    return value ^ (value >> 31);
+}
+
+// Zobrist key for a tile in one cell.  The keys are derived on the fly
+// rather than kept in a 512K-entry table.
+uint64_t zobristKey(int layer, int cell, tile_t tile)
+{
+    return mix64(((uint64_t)layer << 20) | ((uint64_t)cell << 8) | tile);
+}
+
+// The player's facing doesn't affect play, so it's left out of the hash
+tile_t normalizeTile(tile_t tile)
+{
+    if (tile >= ccl::TilePlayer_N && tile <= ccl::TilePlayer_E)
+        return ccl::TilePlayer_N;
+    if (tile >= ccl::TilePlayerSwim_N && tile <= ccl::TilePlayerSwim_E)
+        return ccl::TilePlayerSwim_N;
+    return tile;
+}
+
+// Most moves only change a few cells, so layers are compared against the
+// initial state a chunk at a time before looking at individual tiles
+#define CHUNK_SIZE  64
+
+bool chunkDiffers(const tile_t* tiles, const tile_t* base)
+{
+    // Branch-free, so the compiler can vectorize it
+    uint64_t diff = 0;
+    for (int i = 0; i < CHUNK_SIZE; i += 8) {
+        uint64_t word, baseWord;
+        memcpy(&word, tiles + i, sizeof(word));
+        memcpy(&baseWord, base + i, sizeof(baseWord));
+        diff |= word ^ baseWord;
+    }
+    return diff != 0;
+}
+
+// Hashes the cells which differ from the initial state.  This is the
+// Zobrist hash of the whole layer, up to a constant.
+uint64_t hashLayer(int layer, const tile_t* tiles, const tile_t* base)
+{
+    uint64_t hash = 0;
+    for (int chunk = 0; chunk < CCL_WIDTH * CCL_HEIGHT; chunk += CHUNK_SIZE) {
+        if (!chunkDiffers(tiles + chunk, base + chunk))
+            continue;
+        for (int i = chunk; i < chunk + CHUNK_SIZE; ++i) {
+            if (tiles[i] == base[i])
+                continue;
+            const tile_t tile = normalizeTile(tiles[i]);
+            const tile_t baseTile = normalizeTile(base[i]);
+            if (tile != baseTile)
+                hash ^= zobristKey(layer, i, tile) ^ zobristKey(layer, i, baseTile);
+        }
+    }
+    return hash;
+}
+
+uint64_t hashState(const ccl::GameState& state, const ccl::GameState& base)
+{
+    uint64_t hash = hashLayer(0, state.fg, base.fg) ^ hashLayer(1, state.bg, base.bg);
+
+    uint64_t extra = mix64(state.chipsLeft);
+    auto feed = [&extra](uint64_t value) { extra = mix64(extra ^ value); };
+    for (int i = 0; i < 4; ++i)
+        feed(((uint64_t)state.keys[i] << 8) | state.boots[i]);
+    const ccl::GameCreature& player = state.player();
+    feed(((uint64_t)player.x << 16) | ((uint64_t)player.y << 8) | player.flags);
+    for (int i = 1; i < state.numCreatures; ++i) {
+        const ccl::GameCreature& cr = state.creatures[i];
+        feed(((uint64_t)cr.x << 40) | ((uint64_t)cr.y << 32) | ((uint64_t)cr.tile << 24)
+             | ((uint64_t)cr.dir << 16) | ((uint64_t)cr.flags << 8) | cr.wait);
+    }
+    for (int i = 0; i < state.numSlipping; ++i)
+        feed(state.slipList[i]);
+
+    // Monsters only move on some ticks, so the phase matters when there
+    // are any.  On timed levels the time left matters too, or a state
+    // reached late could stand in for the same position reached in time.
+    // The RNG state only changes when something random happens.
+    if (state.timeLimit != 0)
+        feed(state.timeLimit - state.tick);
+    else if (state.numCreatures > 1)
+        feed(state.tick & 7);
+    feed(state.rng);
+    return hash ^ extra;
+}
+
+/* States are stored as differences from the initial state, since most
+ * moves change only a few cells */
+void appendLayerDiff(std::vector<uint8_t>& out, const tile_t* tiles, const tile_t* base)
+{
+    const size_t countPos = out.size();
+    out.resize(countPos + 2);
+    uint16_t count = 0;
+    for (int chunk = 0; chunk < CCL_WIDTH * CCL_HEIGHT; chunk += CHUNK_SIZE) {
+        if (!chunkDiffers(tiles + chunk, base + chunk))
+            continue;
+        for (int i = chunk; i < chunk + CHUNK_SIZE; ++i) {
+            if (tiles[i] == base[i])
+                continue;
+            out.push_back((uint8_t)(i & 0xFF));
+            out.push_back((uint8_t)(i >> 8));
+            out.push_back(tiles[i]);
+            ++count;
+        }
+    }
+    out[countPos] = (uint8_t)(count & 0xFF);
+    out[countPos + 1] = (uint8_t)(count >> 8);
+}
+
+template <typename T>
+void appendValue(std::vector<uint8_t>& out, const T& value)
+{
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+void packState(std::vector<uint8_t>& out, const ccl::GameState& state,
+               const ccl::GameState& base)
+{
+    out.insert(out.end(), state.keys, state.keys + 4);
+    out.insert(out.end(), state.boots, state.boots + 4);
+    appendValue(out, state.chipsLeft);
+    appendValue(out, state.tick);
+    appendValue(out, state.rng);
+    out.push_back(state.numCreatures);
+    out.push_back(state.numSlipping);
+    const uint8_t* creatures = reinterpret_cast<const uint8_t*>(state.creatures);
+    out.insert(out.end(), creatures, creatures + state.numCreatures * sizeof(ccl::GameCreature));
+    out.insert(out.end(), state.slipList, state.slipList + state.numSlipping);
+    appendLayerDiff(out, state.fg, base.fg);
+    appendLayerDiff(out, state.bg, base.bg);
+}
+
+const uint8_t* applyLayerDiff(tile_t* tiles, const uint8_t* data)
+{
+    const int count = data[0] | (data[1] << 8);
+    data += 2;
+    for (int i = 0; i < count; ++i, data += 3)
+        tiles[data[0] | (data[1] << 8)] = data[2];
+    return data;
+}
+
+template <typename T>
+const uint8_t* readValue(T& value, const uint8_t* data)
+{
+    memcpy(&value, data, sizeof(T));
+    return data + sizeof(T);
+}
+
+void unpackState(ccl::GameState& state, const uint8_t* data, const ccl::GameState& base)
+{
+    state = base;
+    memcpy(state.keys, data, 4);
+    memcpy(state.boots, data + 4, 4);
+    data += 8;
+    data = readValue(state.chipsLeft, data);
+    data = readValue(state.tick, data);
+    data = readValue(state.rng, data);
+    state.numCreatures = *data++;
+    state.numSlipping = *data++;
+    memcpy(state.creatures, data, state.numCreatures * sizeof(ccl::GameCreature));
+    data += state.numCreatures * sizeof(ccl::GameCreature);
+    memcpy(state.slipList, data, state.numSlipping);
+    data += state.numSlipping;
+    data = applyLayerDiff(state.fg, data);
+    applyLayerDiff(state.bg, data);
+}
+
+/* Transposition table shared by all workers.  Among children of the same
+ * depth, the one reached from the lowest frontier position and action
+ * wins, so the search doesn't depend on thread timing.  Each shard is an
+ * open-addressed table, which avoids a node allocation per state. */
+class TranspositionTable {
+public:
+    TranspositionTable() : m_size(0) { }
+
+    // Returns false if the state was already seen at an earlier depth, or
+    // at this depth from an earlier (parent, action)
+    bool claim(uint64_t hash, uint32_t depth, uint64_t ordinal)
+    {
+        Shard& shard = m_shards[hash % NumShards];
+        std::lock_guard<std::mutex> guard(shard.lock);
+        if ((shard.count + 1) * 2 > shard.entries.size())
+            grow(shard);
+
+        Entry& entry = find(shard, hash);
+        if (entry.hash == 0) {
+            entry = Entry { keyOf(hash), depth, ordinal };
+            ++shard.count;
+            ++m_size;
+            return true;
+        }
+        if (entry.depth != depth || entry.ordinal < ordinal)
+            return false;
+        entry.ordinal = ordinal;
+        return true;
+    }
+
+    // Only valid once every worker is done with the current depth
+    bool owns(uint64_t hash, uint64_t ordinal)
+    {
+        return find(m_shards[hash % NumShards], hash).ordinal == ordinal;
+    }
+
+    size_t size() const { return m_size; }
+
+private:
+    enum { NumShards = 64 };
+
+    // A hash of 0 marks an empty entry
+    struct Entry {
+        uint64_t hash;
+        uint32_t depth;
+        uint64_t ordinal;
+    };
+
+    struct Shard {
+        Shard() : count() { }
+
+        std::mutex lock;
+        std::vector<Entry> entries;
+        size_t count;
+    };
+
+    Shard m_shards[NumShards];
+    std::atomic<size_t> m_size;
+
+    static uint64_t keyOf(uint64_t hash) { return hash ? hash : 1; }
+
+    static Entry& find(Shard& shard, uint64_t hash)
+    {
+        // The low bits pick the shard, so probe from the high bits
+        const uint64_t key = keyOf(hash);
+        const size_t mask = shard.entries.size() - 1;
+        for (size_t slot = (size_t)(hash >> 32) & mask; ; slot = (slot + 1) & mask) {
+            Entry& entry = shard.entries[slot];
+            if (entry.hash == key || entry.hash == 0)
+                return entry;
+        }
+    }
+
+    static void grow(Shard& shard)
+    {
+        std::vector<Entry> old(std::max<size_t>(shard.entries.size() * 2, 1024));
+        old.swap(shard.entries);
+        for (const Entry& entry : old) {
+            if (entry.hash != 0)
+                find(shard, entry.hash) = entry;
+        }
+    }
+};
+
+struct Child {
+    uint64_t hash;
+    uint64_t ordinal;       // Parent's frontier position * NumActions + action
+    size_t offset;          // Packed state in the block's data
+};
+
+struct Block {
+    static const uint64_t NoWin = ~(uint64_t)0;
+
+    Block() : winOrdinal(NoWin), winTicks() { }
+
+    std::vector<Child> children;
+    std::vector<uint8_t> data;
+    uint64_t winOrdinal;
+    uint32_t winTicks;
+};
+
+struct Node {
+    uint32_t parent;
+    uint8_t action;
+};
+
+}
+
+ccl::SolveResult ccl::Solver::solve(Ruleset ruleset, const LevelData* level, uint32_t seed)
+{
+    m_cancel = false;
+
+    unsigned int threads = m_threads;
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+    std::vector<std::unique_ptr<GameEngine>> engines;
+    for (unsigned int i = 0; i < threads; ++i) {
+        engines.emplace_back(GameEngine::create(ruleset));
+        engines.back()->reset(level, seed);
+    }
+
+    SolveResult result;
+    GameEngine* engine = engines.front().get();
+    const GameState base = engine->state();
+    if (engine->status() != GameRunning) {
+        result.statesVisited = 1;
+        return result;
+    }
+
+    TranspositionTable table;
+    table.claim(hashState(base, base), 0, 0);
+
+    std::vector<Node> nodes { Node { 0, 0 } };
+    std::vector<uint32_t> frontierNodes { 0 };
+    std::vector<size_t> frontierOffsets { 0 };
+    std::vector<uint8_t> frontierData;
+    packState(frontierData, base, base);
+
+    std::atomic<bool> limitReached(false);
+    for (uint32_t depth = 1; !frontierNodes.empty(); ++depth) {
+        const size_t frontierSize = frontierNodes.size();
+        const size_t numBlocks = (frontierSize + SOLVER_BLOCK_SIZE - 1) / SOLVER_BLOCK_SIZE;
+        std::vector<Block> blocks(numBlocks);
+        std::atomic<size_t> nextBlock(0);
+
+        auto worker = [&](unsigned int workerId) {
+            GameEngine* engine = engines[workerId].get();
+            GameState parent;
+            for ( ;; ) {
+                const size_t blockIndex = nextBlock++;
+                if (blockIndex >= numBlocks || m_cancel || limitReached)
+                    return;
+
+                Block& block = blocks[blockIndex];
+                const size_t first = blockIndex * SOLVER_BLOCK_SIZE;
+                const size_t last = std::min(first + SOLVER_BLOCK_SIZE, frontierSize);
+                for (size_t pos = first; pos < last; ++pos) {
+                    unpackState(parent, &frontierData[frontierOffsets[pos]], base);
+                    const int numActions = (parent.numCreatures > 1) ? NumActions : ActionWait;
+                    for (int action = 0; action < numActions; ++action) {
+                        engine->restore(parent);
+                        engine->tick((action == ActionWait) ? DirInvalid
+                                                            : (Direction)(DirNorth + action));
+                        for (int settle = 0; engine->status() == GameRunning
+                                             && !engine->playerReady(); ++settle) {
+                            if (settle == SOLVER_SETTLE_TICKS)
+                                break;
+                            engine->tick(DirInvalid);
+                        }
+
+                        const uint64_t ordinal = (pos * NumActions) + action;
+                        const GameState& child = engine->state();
+                        if (child.status == GameWon) {
+                            if (ordinal < block.winOrdinal) {
+                                block.winOrdinal = ordinal;
+                                block.winTicks = child.tick;
+                            }
+                            continue;
+                        }
+                        if (child.status != GameRunning || !engine->playerReady())
+                            continue;
+
+                        const uint64_t hash = hashState(child, base);
+                        if (!table.claim(hash, depth, ordinal))
+                            continue;
+                        block.children.push_back(Child { hash, ordinal, block.data.size() });
+                        packState(block.data, child, base);
+                    }
+                }
+                if (table.size() > m_maxStates)
+                    limitReached = true;
+            }
+        };
+
+        const unsigned int workers = (unsigned int)std::min<size_t>(threads, numBlocks);
+        std::vector<std::thread> pool;
+        for (unsigned int i = 1; i < workers; ++i)
+            pool.emplace_back(worker, i);
+        worker(0);
+        for (std::thread& thread : pool)
+            thread.join();
+
+        result.statesVisited = table.size();
+        if (m_cancel) {
+            result.outcome = SolveResult::Cancelled;
+            return result;
+        }
+
+        // Blocks are in frontier order, so the first win is the lowest
+        for (const Block& block : blocks) {
+            if (block.winOrdinal == Block::NoWin)
+                continue;
+
+            std::vector<uint8_t> actions { (uint8_t)(block.winOrdinal % NumActions) };
+            for (uint32_t node = frontierNodes[block.winOrdinal / NumActions]; node != 0;
+                 node = nodes[node].parent)
+                actions.push_back(nodes[node].action);
+            for (auto action = actions.rbegin(); action != actions.rend(); ++action)
+                result.moves.push_back((*action == ActionWait) ? DirInvalid
+                                                               : (Direction)(DirNorth + *action));
+            result.outcome = SolveResult::Solved;
+            result.ticks = block.winTicks;
+            return result;
+        }
+        if (limitReached) {
+            result.outcome = SolveResult::LimitReached;
+            return result;
+        }
+
+        std::vector<uint32_t> nextNodes;
+        std::vector<size_t> nextOffsets;
+        std::vector<uint8_t> nextData;
+        for (const Block& block : blocks) {
+            for (size_t i = 0; i < block.children.size(); ++i) {
+                const Child& child = block.children[i];
+                if (!table.owns(child.hash, child.ordinal))
+                    continue;
+
+                const size_t end = (i + 1 < block.children.size())
+                                 ? block.children[i + 1].offset : block.data.size();
+                nextNodes.push_back((uint32_t)nodes.size());
+                nextOffsets.push_back(nextData.size());
+                nextData.insert(nextData.end(), block.data.begin() + child.offset,
+                                block.data.begin() + end);
+                nodes.push_back(Node { frontierNodes[child.ordinal / NumActions],
+                                       (uint8_t)(child.ordinal % NumActions) });
+            }
+        }
+        frontierNodes.swap(nextNodes);
+        frontierOffsets.swap(nextOffsets);
+        frontierData.swap(nextData);
+    }
+
+    result.outcome = SolveResult::Unsolvable;
+    return result;
+}
@@ -0,0 +1,68 @@
+/******************************************************************************
+ * This file is part of CCTools.                                              *
+ *                                                                            *
+ * CCTools is free software: you can redistribute it and/or modify            *
+ * it under the terms of the GNU General Public License as published by       *
+ * the Free Software Foundation, either version 3 of the License, or          *
+ * (at your option) any later version.                                        *
+ *                                                                            *
+ * CCTools is distributed in the hope that it will be useful,                 *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with CCTools.  If not, see <http://www.gnu.org/licenses/>.           *
+ ******************************************************************************/
+
+#ifndef _SOLVER_H
+#define _SOLVER_H
+
+#include <atomic>
+#include "GameEngine.h"
+
+namespace ccl {
+
+struct SolveResult {
+    enum Outcome {
+        Solved,
+        Unsolvable,     // Every reachable state was searched
+        LimitReached,   // Gave up after the state limit
+        Cancelled,
+    };
+
+    SolveResult() : outcome(Unsolvable), ticks(), statesVisited() { }
+
+    Outcome outcome;
+    std::vector<Direction> moves;   // DirInvalid is a wait
+    uint32_t ticks;                 // Ticks taken by the solution
+    size_t statesVisited;
+};
+
+/* Breadth-first search over the player's moves, so a solution found is
+ * the shortest in moves.  States are deduplicated with a Zobrist hash of
+ * both map layers, inventory, chips and the creature list.  Waiting is
+ * only tried when there are monsters, so levels without them search only
+ * the puzzle itself. */
+class Solver {
+public:
+    Solver() : m_threads(), m_maxStates(1000000), m_cancel() { }
+
+    // A thread count of 0 uses one worker per hardware thread
+    void setThreads(unsigned int threads) { m_threads = threads; }
+    void setMaxStates(size_t maxStates) { m_maxStates = maxStates; }
+
+    SolveResult solve(Ruleset ruleset, const LevelData* level, uint32_t seed = 0);
+
+    // May be called from any thread while solve() is running
+    void cancel() { m_cancel = true; }
+
+private:
+    unsigned int m_threads;
+    size_t m_maxStates;
+    std::atomic<bool> m_cancel;
+};
+
+}
+
+#endif
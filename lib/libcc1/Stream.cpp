@@ -20,6 +20,26 @@
 #include <cstring>
 #include <vector>
 #include <algorithm>
+#include <limits>
+
+#if defined(__AVX2__)
+#   include <immintrin.h>
+#   define RLE_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#   include <emmintrin.h>
+#   define RLE_SSE2
+#endif
+
+#ifdef Q_OS_WIN
+#   define WIN32_LEAN_AND_MEAN
+#   define NOMINMAX
+#   include <windows.h>
+#else
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <fcntl.h>
+#   include <unistd.h>
+#endif
 
 uint8_t ccl::Stream::read8()
 {
@@ -73,8 +93,61 @@ void ccl::Stream::readRLE(tile_t* dest, size_t size)
         throw ccl::IOError(ccl::RuntimeError::tr("RLE buffer underflow"));
 }
 
+size_t ccl::Stream::decodeRLE(tile_t* dest, size_t size, const uint8_t* src,
+                              size_t srcSize)
+{
+    // Same format and error behavior as readRLE(), but decoded directly
+    // from a contiguous buffer.  Returns the number of source bytes consumed.
+    if (srcSize < sizeof(uint16_t))
+        throw ccl::IOError(ccl::RuntimeError::tr("Read past end of stream"));
+
+    const uint8_t* sp = src + sizeof(uint16_t);
+    const uint8_t* const srcEnd = src + srcSize;
+    int dataLen = (int)src[0] | ((int)src[1] << 8);
+    tile_t* cur = dest;
+    tile_t* const destEnd = dest + size;
+    while (dataLen > 0 && cur < destEnd) {
+        // Copy the literal span up to the next RLE marker in one go
+        const size_t maxLiteral = std::min({(size_t)dataLen, (size_t)(destEnd - cur),
+                                            (size_t)(srcEnd - sp)});
+        auto marker = reinterpret_cast<const uint8_t*>(memchr(sp, 0xFF, maxLiteral));
+        const size_t literal = marker ? (size_t)(marker - sp) : maxLiteral;
+        memcpy(cur, sp, literal);
+        cur += literal;
+        sp += literal;
+        dataLen -= (int)literal;
+        if (!marker) {
+            if (dataLen > 0 && cur < destEnd)
+                throw ccl::IOError(ccl::RuntimeError::tr("Read past end of stream"));
+            break;
+        }
+
+        if (srcEnd - sp < 3)
+            throw ccl::IOError(ccl::RuntimeError::tr("Read past end of stream"));
+        const unsigned char count = sp[1];
+        const tile_t tile = (tile_t)sp[2];
+        if (count > (size_t)(destEnd - cur))
+            throw ccl::IOError(ccl::RuntimeError::tr("RLE buffer overflow"));
+        if ((dataLen - 3) < 0)
+            throw ccl::IOError(ccl::RuntimeError::tr("RLE buffer underflow"));
+        memset(cur, tile, count);
+        cur += count;
+        sp += 3;
+        dataLen -= 3;
+    }
+
+    if (dataLen != 0)
+        throw ccl::IOError(ccl::RuntimeError::tr("RLE buffer overflow"));
+    if (cur != destEnd)
+        throw ccl::IOError(ccl::RuntimeError::tr("RLE buffer underflow"));
+    return (size_t)(sp - src);
+}
+
 std::string ccl::Stream::readString(size_t length, bool password)
 {
+    if (length == 0)
+        return std::string();
+
     std::unique_ptr<char[]> buffer(new char[length]);
     if (read(buffer.get(), 1, length) != length)
         throw ccl::IOError(ccl::RuntimeError::tr("Read past end of stream"));
@@ -123,51 +196,113 @@ void ccl::Stream::write32(uint32_t value)
         throw ccl::IOError(ccl::RuntimeError::tr("Error writing to stream"));
 }
 
-static uint16_t rleLength(const tile_t* src, size_t size)
+static inline int lowestBit32(uint32_t value)
 {
-    // Pre-compute the length of RLE-encoded data, so we don't have to
-    // perform extra allocations, seeks, etc. during the writing process
-    const tile_t* cur = src;
-    int dataLen = 0;
-    while (cur < (src + size)) {
-        int count = 1;
-        tile_t tile = *cur++;
-        while ((cur < (src + size)) && (count < 255) && (*cur == tile)) {
-            ++cur;
-            ++count;
-        }
-        if (count > 3 || tile == (tile_t)0xff)
-            dataLen += 3;
-        else
-            dataLen += count;
+#if defined(__GNUC__)
+    return __builtin_ctz(value);
+#else
+    int bit = 0;
+    while ((value & 1) == 0) {
+        value >>= 1;
+        ++bit;
     }
-    return (uint16_t)dataLen;
+    return bit;
+#endif
 }
 
-long ccl::Stream::writeRLE(const tile_t* src, size_t size)
+// Number of bytes from cur (up to end) which are equal to tile
+static inline size_t matchLength(const tile_t* cur, const tile_t* end, tile_t tile)
 {
-    long begin = tell();
+    const tile_t* start = cur;
+#if defined(RLE_AVX2)
+    const __m256i vtile = _mm256_set1_epi8((char)tile);
+    while (end - cur >= 32) {
+        const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(cur));
+        const uint32_t same = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, vtile));
+        if (same != 0xFFFFFFFFU)
+            return (size_t)(cur - start) + lowestBit32(~same);
+        cur += 32;
+    }
+#endif
+#if defined(RLE_AVX2) || defined(RLE_SSE2)
+    const __m128i vtile16 = _mm_set1_epi8((char)tile);
+    while (end - cur >= 16) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cur));
+        const uint32_t same = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, vtile16));
+        if (same != 0xFFFFU)
+            return (size_t)(cur - start) + lowestBit32(~same);
+        cur += 16;
+    }
+#endif
+    while (cur < end && *cur == tile)
+        ++cur;
+    return (size_t)(cur - start);
+}
 
-    write16(rleLength(src, size));
+// Encodes the layer into out (if non-null), returning the encoded length.
+// Runs of more than 3 tiles (up to 255), and any 0xFF tile, are written
+// as a 3-byte 0xFF escape; everything else is written literally.
+template <bool Emit>
+static size_t encodeRLE(uint8_t* out, const tile_t* src, size_t size)
+{
     const tile_t* cur = src;
-    while (cur < (src + size)) {
-        int count = 1;
-        tile_t tile = *cur++;
-        while ((cur < (src + size)) && (count < 255) && (*cur == tile)) {
-            ++cur;
+    const tile_t* end = src + size;
+    size_t dataLen = 0;
+    while (cur < end) {
+        const tile_t tile = *cur;
+        const tile_t* limit = (end - cur > 255) ? cur + 255 : end;
+
+        // Most runs are short, so only hand off to the vector scan once
+        // the run is long enough to be escaped
+        size_t count = 1;
+        while (count < 4 && cur + count < limit && cur[count] == tile)
             ++count;
-        }
+        if (count == 4)
+            count += matchLength(cur + 4, limit, tile);
         if (count > 3 || tile == (tile_t)0xff) {
-            write8(0xFF);
-            write8((uint8_t)count);
-            write8((uint8_t)tile);
+            if (Emit) {
+                out[dataLen] = 0xFF;
+                out[dataLen + 1] = (uint8_t)count;
+                out[dataLen + 2] = (uint8_t)tile;
+            }
+            dataLen += 3;
         } else {
-            for (int i=0; i<count; ++i)
-                write8((uint8_t)tile);
+            if (Emit) {
+                for (size_t i = 0; i < count; ++i)
+                    out[dataLen + i] = (uint8_t)tile;
+            }
+            dataLen += count;
         }
+        cur += count;
+    }
+    return dataLen;
+}
+
+uint16_t ccl::Stream::rleLength(const tile_t* src, size_t size)
+{
+    return (uint16_t)encodeRLE<false>(nullptr, src, size);
+}
+
+long ccl::Stream::writeRLE(const tile_t* src, size_t size)
+{
+    // Encode into a buffer sized for the worst case (every tile a 3-byte
+    // escape) in a single pass, then back-fill the length prefix
+    uint8_t localBuffer[sizeof(uint16_t) + (3 * 1024)];
+    std::unique_ptr<uint8_t[]> heapBuffer;
+    uint8_t* encoded = localBuffer;
+    if (size > 1024) {
+        heapBuffer.reset(new uint8_t[sizeof(uint16_t) + (3 * size)]);
+        encoded = heapBuffer.get();
     }
 
-    return tell() - begin;
+    const size_t dataLen = encodeRLE<true>(encoded + sizeof(uint16_t), src, size);
+    encoded[0] = (uint8_t)(dataLen & 0xFF);
+    encoded[1] = (uint8_t)((dataLen >> 8) & 0xFF);
+
+    const size_t encodedSize = sizeof(uint16_t) + dataLen;
+    if (write(encoded, 1, encodedSize) != encodedSize)
+        throw ccl::IOError(ccl::RuntimeError::tr("Error writing to stream"));
+    return (long)encodedSize;
 }
 
 void ccl::Stream::writeString(const std::string& value, bool password)
@@ -198,40 +333,106 @@ size_t ccl::Stream::copyBytes(ccl::Stream* out, size_t size)
     return out->write(bytes.get(), 1, nread);
 }
 
+static inline void copy_backref(uint8_t* dest, size_t offset, size_t length)
+{
+    // Back-references may overlap the bytes they produce, in which case
+    // the last `offset` bytes repeat as a pattern
+    const uint8_t* src = dest - offset;
+    if (offset >= length) {
+        memcpy(dest, src, length);
+    } else if (offset == 1) {
+        memset(dest, *src, length);
+    } else {
+        memcpy(dest, src, offset);
+        size_t copied = offset;
+        while (copied < length) {
+            const size_t chunk = std::min(copied, length - copied);
+            memcpy(dest + copied, dest, chunk);
+            copied += chunk;
+        }
+    }
+}
+
 std::unique_ptr<ccl::Stream> ccl::Stream::unpack(long packedLength)
 {
-    std::unique_ptr<ccl::BufferStream> ustream(new ccl::BufferStream);
     uint16_t unpackedSize = read16();
     packedLength -= sizeof(unpackedSize);
+    if (packedLength < 0)
+        packedLength = 0;
 
-    while (packedLength > 0) {
-        uint8_t control = read8();
-        packedLength -= 1;
+    const long available = std::max(size() - tell(), 0L);
+    if (packedLength > available)
+        throw ccl::IOError(ccl::RuntimeError::tr("Read past end of stream"));
+
+    // The last block may run past packedLength into the rest of the stream,
+    // as the byte-at-a-time decoder allowed, so up to one block's worth of
+    // trailing bytes is made available as well
+    const long spanLength = std::min(available, packedLength + 0x80);
+
+    // Decode from the packed bytes in place if they are already in memory,
+    // otherwise pull in the whole block with a single read
+    const uint8_t* packed = buffer();
+    std::unique_ptr<uint8_t[]> packedCopy;
+    if (packed) {
+        packed += tell();
+    } else {
+        packedCopy.reset(new uint8_t[spanLength]);
+        if (read(packedCopy.get(), 1, spanLength) != (size_t)spanLength)
+            throw ccl::IOError(ccl::RuntimeError::tr("Read past end of stream"));
+        packed = packedCopy.get();
+    }
+    const uint8_t* pp = packed;
+    const uint8_t* const packedEnd = packed + packedLength;
+    const uint8_t* const dataEnd = packed + spanLength;
+
+    // The header only stores the low 16 bits of the unpacked size, so the
+    // buffer is grown in 64 KiB steps in the rare case it is exceeded
+    std::unique_ptr<ccl::BufferStream> ustream(new ccl::BufferStream);
+    size_t capacity = std::max<size_t>(unpackedSize, 1);
+    uint8_t* out = ustream->resize(capacity);
+    size_t outPos = 0;
+
+    auto reserve = [&](size_t count) {
+        while (outPos + count > capacity)
+            capacity += 0x10000;
+        out = ustream->resize(capacity);
+    };
+
+    while (pp < packedEnd) {
+        uint8_t control = *pp++;
         if (control >= 0x80) {
             // Copy block
-            uint8_t offset = read8();
-            packedLength -= 1;
+            if (pp == dataEnd)
+                throw ccl::IOError(ccl::RuntimeError::tr("Read past end of stream"));
+            uint8_t offset = *pp++;
 
-            if (offset == 0 || offset > ustream->tell())
+            if (offset == 0 || offset > outPos)
                 throw ccl::IOError(ccl::RuntimeError::tr("Pack offset invalid"));
 
-            // Need to copy only one byte at a time, to ensure that bytes
-            // written to the output can be looped correctly
             control -= 0x80;
-            while (control--) {
-                uint8_t copy = ustream->buffer()[ustream->tell() - offset];
-                ustream->write8(copy);
-            }
+            if (outPos + control > capacity)
+                reserve(control);
+            copy_backref(out + outPos, offset, control);
+            outPos += control;
         } else {
-            if (copyBytes(ustream.get(), control) != control)
+            if (control > (size_t)(dataEnd - pp))
                 throw ccl::IOError(ccl::RuntimeError::tr("Read past end of stream"));
-            packedLength -= control;
+            if (outPos + control > capacity)
+                reserve(control);
+            memcpy(out + outPos, pp, control);
+            pp += control;
+            outPos += control;
         }
     }
 
-    if (unpackedSize != (ustream->size() & 0xffff))
+    // Leave the stream just past the last byte consumed
+    const long consumed = (long)(pp - packed);
+    seek(packedCopy ? consumed - spanLength : consumed, SEEK_CUR);
+
+    if (unpackedSize != (outPos & 0xffff))
         throw ccl::IOError(ccl::RuntimeError::tr("Packed data did not match expected length"));
 
+    ustream->resize(outPos);
     ustream->seek(0, SEEK_SET);
     return ustream;
 }
@@ -244,65 +445,196 @@ static long match_length(const uint8_t* m1, const uint8_t *m2, long max)
     return length;
 }
 
-long ccl::Stream::pack(Stream* unpacked)
-{
-    unpacked->seek(0, SEEK_SET);
+// Back-references in the CC2 pack format can reach up to 255 bytes back,
+// and encode up to 127 bytes; literal blocks are also limited to 127 bytes.
+#define PACK_WINDOW         0xff
+#define PACK_MAX_LENGTH     0x7f
+#define PACK_MAX_LITERAL    0x7f
+#define PACK_MIN_MATCH      4
 
-    std::vector<uint8_t> bytes;
-    const size_t unpackedSize = unpacked->size();
-    bytes.resize(unpackedSize);
-    if (unpacked->read(&bytes[0], 1, unpackedSize) != unpackedSize)
-        throw ccl::RuntimeError(ccl::RuntimeError::tr("Failed reading unpacked data"));
+#define PACK_HASH_BITS      12
+#define PACK_HASH_SIZE      (1 << PACK_HASH_BITS)
 
-    // Write the unpacked size checksum
-    write16(static_cast<uint16_t>(unpackedSize & 0xffff));
+static inline uint32_t pack_hash(const uint8_t* bytes)
+{
+    uint32_t key;
+    memcpy(&key, bytes, sizeof(key));
+    return (key * 2654435761U) >> (32 - PACK_HASH_BITS);
+}
+
+static void pack_literals(std::vector<uint8_t>& packed, const uint8_t* bytes,
+                          long begin, long end)
+{
+    while (begin < end) {
+        long take_bytes = std::min(end - begin, long(PACK_MAX_LITERAL));
+        packed.push_back(static_cast<uint8_t>(take_bytes));
+        packed.insert(packed.end(), bytes + begin, bytes + begin + take_bytes);
+        begin += take_bytes;
+    }
+}
 
-    // LZSS-like compression
+static void pack_greedy(std::vector<uint8_t>& packed, const std::vector<uint8_t>& bytes)
+{
+    // LZSS-like compression.  Candidate matches are found through hash
+    // chains over the first PACK_MIN_MATCH bytes, since shorter matches are
+    // never encoded.  Each position's chain link only needs to live as long
+    // as it is inside the window, so the links are kept in a ring buffer.
+    std::vector<int32_t> head(PACK_HASH_SIZE, -1);
+    int32_t chain[PACK_WINDOW + 1];
+
+    const long size = static_cast<long>(bytes.size());
     long pos = 0;
-    long packedSize = sizeof(uint16_t);
-    std::vector<uint8_t> accum;
-
-    auto flush_accum = [&] {
-        while (!accum.empty()) {
-            size_t take_bytes = std::min(accum.size(), size_t(0x7f));
-            write8(static_cast<uint8_t>(take_bytes));
-            write(&accum[0], 1, take_bytes);
-            accum.erase(accum.begin(), accum.begin() + take_bytes);
-            packedSize += 1 + take_bytes;
+    long hashed = 0;
+
+    // Literals are always a contiguous span of the input, so they can be
+    // copied straight from it instead of being accumulated separately
+    long literalStart = 0;
+
+    while (pos < size) {
+        // Bring the hash chains up to date with everything before pos
+        for ( ; hashed < pos && hashed + PACK_MIN_MATCH <= size; ++hashed) {
+            const uint32_t hash = pack_hash(&bytes[hashed]);
+            chain[hashed & PACK_WINDOW] = head[hash];
+            head[hash] = static_cast<int32_t>(hashed);
         }
-    };
 
-    while (static_cast<size_t>(pos) < bytes.size()) {
         long longest_match_len = 0;
         long longest_match_seek = 0;
-        long mSeek = std::max(0L, pos - 0xffL);
-        while (mSeek < pos) {
-            long mLen = std::min(match_length(&bytes[pos], &bytes[mSeek], bytes.size() - pos),
-                                 0x7fL);
-            if (mLen > longest_match_len) {
-                longest_match_len = mLen;
-                longest_match_seek = pos - mSeek;
+        if (pos + PACK_MIN_MATCH <= size) {
+            const long maxLen = std::min(size - pos, long(PACK_MAX_LENGTH));
+            const uint8_t* cur = &bytes[pos];
+            long mSeek = head[pack_hash(cur)];
+
+            // Walk from the nearest candidate to the farthest.  Ties are
+            // resolved in favor of the farthest match, which is what the
+            // original exhaustive search produced.
+            while (mSeek >= 0 && pos - mSeek <= PACK_WINDOW) {
+                const uint8_t* cand = &bytes[mSeek];
+                if (longest_match_len == 0
+                        || cand[longest_match_len - 1] == cur[longest_match_len - 1]) {
+                    long mLen = match_length(cur, cand, maxLen);
+                    if (mLen >= PACK_MIN_MATCH && mLen >= longest_match_len) {
+                        longest_match_len = mLen;
+                        longest_match_seek = pos - mSeek;
+                    }
+                }
+                mSeek = chain[mSeek & PACK_WINDOW];
             }
-            ++mSeek;
         }
-        if (longest_match_len > 3) {
-            flush_accum();
+
+        if (longest_match_len >= PACK_MIN_MATCH) {
+            pack_literals(packed, bytes.data(), literalStart, pos);
 
             // Encode this as a back-reference
-            write8(static_cast<uint8_t>(0x80 + longest_match_len));
-            write8(static_cast<uint8_t>(longest_match_seek));
-            packedSize += 2;
+            packed.push_back(static_cast<uint8_t>(0x80 + longest_match_len));
+            packed.push_back(static_cast<uint8_t>(longest_match_seek));
             pos += longest_match_len;
+            literalStart = pos;
         } else {
-            accum.push_back(bytes[pos]);
             pos += 1;
         }
     }
 
     // Flush any leftover unencoded bytes
-    flush_accum();
+    pack_literals(packed, bytes.data(), literalStart, pos);
+}
+
+static void pack_optimal(std::vector<uint8_t>& packed, const std::vector<uint8_t>& bytes)
+{
+    // Shortest-path parse over every token the format allows: literal
+    // blocks of 1-127 bytes (1 + N bytes each) and back-references of
+    // 2-127 bytes at offsets 1-255 (2 bytes each).  cost[pos] holds the
+    // smallest encoding of bytes[pos..size).
+    const long size = static_cast<long>(bytes.size());
+    std::vector<uint32_t> cost(size + 1);
+    std::vector<uint8_t> tokenLen(size);
+    std::vector<uint8_t> tokenOffset(size);
+
+    // runLength[offset] is the length of the match between pos and
+    // pos - offset, capped to what a single token can encode.  Since the
+    // parse runs backwards, each entry extends the one computed at pos + 1.
+    uint8_t runLength[PACK_WINDOW + 1] = { 0 };
+
+    cost[size] = 0;
+    for (long pos = size - 1; pos >= 0; --pos) {
+        long bestLen = 0;
+        long bestOffset = 0;
+        const long maxOffset = std::min(pos, long(PACK_WINDOW));
+        for (long offset = 1; offset <= maxOffset; ++offset) {
+            if (bytes[pos] == bytes[pos - offset]) {
+                if (runLength[offset] < PACK_MAX_LENGTH)
+                    ++runLength[offset];
+            } else {
+                runLength[offset] = 0;
+            }
+            if (runLength[offset] > bestLen) {
+                bestLen = runLength[offset];
+                bestOffset = offset;
+            }
+        }
 
-    return packedSize;
+        uint32_t bestCost = std::numeric_limits<uint32_t>::max();
+        const long maxLiteral = std::min(size - pos, long(PACK_MAX_LITERAL));
+        for (long length = 1; length <= maxLiteral; ++length) {
+            const uint32_t tryCost = 1 + length + cost[pos + length];
+            if (tryCost < bestCost) {
+                bestCost = tryCost;
+                tokenLen[pos] = static_cast<uint8_t>(length);
+                tokenOffset[pos] = 0;
+            }
+        }
+        for (long length = 2; length <= bestLen; ++length) {
+            const uint32_t tryCost = 2 + cost[pos + length];
+            if (tryCost < bestCost) {
+                bestCost = tryCost;
+                tokenLen[pos] = static_cast<uint8_t>(length);
+                tokenOffset[pos] = static_cast<uint8_t>(bestOffset);
+            }
+        }
+        cost[pos] = bestCost;
+    }
+
+    packed.reserve(packed.size() + cost[0]);
+    long pos = 0;
+    while (pos < size) {
+        const long length = tokenLen[pos];
+        if (tokenOffset[pos] != 0) {
+            packed.push_back(static_cast<uint8_t>(0x80 + length));
+            packed.push_back(tokenOffset[pos]);
+        } else {
+            packed.push_back(static_cast<uint8_t>(length));
+            packed.insert(packed.end(), bytes.begin() + pos, bytes.begin() + pos + length);
+        }
+        pos += length;
+    }
+}
+
+long ccl::Stream::pack(Stream* unpacked, PackMode mode)
+{
+    unpacked->seek(0, SEEK_SET);
+
+    std::vector<uint8_t> bytes;
+    const size_t unpackedSize = unpacked->size();
+    bytes.resize(unpackedSize);
+    if (unpacked->read(bytes.data(), 1, unpackedSize) != unpackedSize)
+        throw ccl::RuntimeError(ccl::RuntimeError::tr("Failed reading unpacked data"));
+
+    std::vector<uint8_t> packed;
+    packed.reserve(sizeof(uint16_t) + unpackedSize + (unpackedSize / PACK_MAX_LITERAL) + 1);
+
+    // Write the unpacked size checksum
+    packed.push_back(static_cast<uint8_t>(unpackedSize & 0xff));
+    packed.push_back(static_cast<uint8_t>((unpackedSize >> 8) & 0xff));
+
+    if (mode == PackOptimal)
+        pack_optimal(packed, bytes);
+    else
+        pack_greedy(packed, bytes);
+
+    if (write(packed.data(), 1, packed.size()) != packed.size())
+        throw ccl::IOError(ccl::RuntimeError::tr("Error writing to stream"));
+
+    return static_cast<long>(packed.size());
 }
 
 
@@ -407,6 +739,22 @@ void ccl::BufferStream::setFrom(const void* buffer, size_t size)
     m_offs = 0;
 }
 
+uint8_t* ccl::BufferStream::resize(size_t size)
+{
+    if (size > m_alloc) {
+        auto largeBuf = new unsigned char[size];
+        if (m_buffer)
+            memcpy(largeBuf, m_buffer, m_size);
+        delete[] m_buffer;
+        m_buffer = largeBuf;
+        m_alloc = size;
+    }
+    m_size = size;
+    if (m_offs > m_size)
+        m_offs = m_size;
+    return m_buffer;
+}
+
 size_t ccl::BufferStream::read(void* buffer, size_t size, size_t count)
 {
     if (!m_buffer)
@@ -438,18 +786,12 @@ size_t ccl::BufferStream::write(const void* buffer, size_t size, size_t count)
         m_alloc = bigger;
     }
 
-    size_t numCopied = 0;
-    auto bufPtr = reinterpret_cast<const unsigned char*>(buffer);
-    while (count > 0) {
-        memcpy(m_buffer + m_offs, bufPtr, size);
-        bufPtr += size;
-        m_offs += size;
-        ++numCopied;
-        --count;
-    }
+    // There's always room for everything after the resize above
+    memcpy(m_buffer + m_offs, buffer, size * count);
+    m_offs += size * count;
     if (m_offs > m_size)
         m_size = m_offs;
-    return numCopied;
+    return count;
 }
 
 void ccl::BufferStream::seek(long offset, int whence)
@@ -468,3 +810,110 @@ void ccl::BufferStream::seek(long offset, int whence)
     if (m_offs > m_size)
         m_offs = m_size;
 }
+
+
+size_t ccl::MemoryStream::read(void* buffer, size_t size, size_t count)
+{
+    if (!m_data || size == 0)
+        return 0;
+
+    const size_t numCopied = std::min(count, (m_size - m_offs) / size);
+    memcpy(buffer, m_data + m_offs, numCopied * size);
+    m_offs += numCopied * size;
+    return numCopied;
+}
+
+void ccl::MemoryStream::seek(long offset, int whence)
+{
+    long target;
+    if (whence == SEEK_SET)
+        target = offset;
+    else if (whence == SEEK_CUR)
+        target = (long)m_offs + offset;
+    else if (whence == SEEK_END)
+        target = (long)m_size + offset;
+    else
+        throw ccl::RuntimeError(ccl::RuntimeError::tr("Invalid whence parameter"));
+
+    if (target < 0)
+        target = 0;
+    m_offs = std::min((size_t)target, m_size);
+}
+
+bool ccl::MappedStream::open(const QString& filename)
+{
+    close();
+
+#ifdef Q_OS_WIN
+    static_assert(sizeof(wchar_t) == sizeof(filename.utf16()[0]),
+                  "Size mismatch between wchar_t and QString::utf16()");
+    HANDLE file = CreateFileW(reinterpret_cast<const wchar_t*>(filename.utf16()),
+                              GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize)) {
+        CloseHandle(file);
+        return false;
+    }
+
+    if (fileSize.QuadPart > 0) {
+        HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping) {
+            CloseHandle(file);
+            return false;
+        }
+        // The view keeps the mapping alive, so the handles can be released now
+        m_data = reinterpret_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        CloseHandle(mapping);
+        if (!m_data) {
+            CloseHandle(file);
+            return false;
+        }
+    }
+    CloseHandle(file);
+    m_size = (size_t)fileSize.QuadPart;
+#else
+    int fd = ::open(filename.toLocal8Bit().constData(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        ::close(fd);
+        return false;
+    }
+
+    if (st.st_size > 0) {
+        void* addr = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED) {
+            ::close(fd);
+            return false;
+        }
+        m_data = reinterpret_cast<const uint8_t*>(addr);
+    }
+    ::close(fd);
+    m_size = (size_t)st.st_size;
+#endif
+
+    m_offs = 0;
+    m_open = true;
+    return true;
+}
+
+void ccl::MappedStream::close()
+{
+    if (m_data) {
+#ifdef Q_OS_WIN
+        UnmapViewOfFile(m_data);
+#else
+        munmap(const_cast<uint8_t*>(m_data), m_size);
+#endif
+    }
+    m_data = nullptr;
+    m_size = 0;
+    m_offs = 0;
+    m_open = false;
+}
@@ -58,10 +58,15 @@ public:
     virtual void seek(long offset, int whence) = 0;
     virtual bool eof() = 0;
 
+    // Direct access to the stream's bytes, for memory-backed streams only
+    virtual const uint8_t* buffer() const { return nullptr; }
+
     uint8_t read8();
     uint16_t read16();
     uint32_t read32();
     void readRLE(tile_t* dest, size_t size);
+    static size_t decodeRLE(tile_t* dest, size_t size, const uint8_t* src,
+                            size_t srcSize);
     std::string readString(size_t length, bool password = false);
     std::string readZString();
 
@@ -69,13 +74,19 @@ public:
     void write16(uint16_t value);
     void write32(uint32_t value);
     long writeRLE(const tile_t* src, size_t size);
+    static uint16_t rleLength(const tile_t* src, size_t size);
     void writeString(const std::string& value, bool password = false);
     void writeZString(const std::string& value);
 
     size_t copyBytes(Stream* out, size_t count);
 
     std::unique_ptr<Stream> unpack(long packedLength);
-    long pack(Stream* unpacked);
+
+    enum PackMode {
+        PackGreedy,     // Fast, matches the output of earlier versions
+        PackOptimal,    // Smallest output, slower
+    };
+    long pack(Stream* unpacked, PackMode mode = PackGreedy);
 };
 
 class FileStream : public Stream {
@@ -124,7 +135,11 @@ public:
     ~BufferStream() override { delete[] m_buffer; }
 
     void setFrom(const void* buffer, size_t size);
-    const uint8_t* buffer() const { return m_buffer; }
+
+    // Sets the stream size, keeping existing content.  The returned buffer
+    // may be written directly, up to the new size.
+    uint8_t* resize(size_t size);
+    const uint8_t* buffer() const override { return m_buffer; }
 
     size_t read(void* buffer, size_t size, size_t count) override;
     size_t write(const void* buffer, size_t size, size_t count) override;
@@ -138,6 +153,47 @@ private:
     uint8_t* m_buffer;
 };
 
+/* Read-only view of memory owned by someone else.  The memory must
+ * outlive the stream. */
+class MemoryStream : public Stream {
+public:
+    MemoryStream() : m_data(), m_size(), m_offs() { }
+    MemoryStream(const void* data, size_t size)
+        : m_data(reinterpret_cast<const uint8_t*>(data)), m_size(size), m_offs() { }
+
+    const uint8_t* buffer() const override { return m_data; }
+
+    size_t read(void* buffer, size_t size, size_t count) override;
+    size_t write(const void*, size_t, size_t) override { return 0; }
+    long tell() override { return (long)m_offs; }
+    long size() override { return (long)m_size; }
+    void seek(long offset, int whence) override;
+    bool eof() override { return (m_offs >= m_size); }
+
+protected:
+    const uint8_t* m_data;
+    size_t m_size, m_offs;
+};
+
+/* Read-only stream over a memory-mapped file.  Reads are served directly
+ * from the mapped pages, so no stdio calls are made after open(). */
+class MappedStream : public MemoryStream {
+public:
+    MappedStream() : m_open() { }
+    ~MappedStream() override { close(); }
+
+    MappedStream(const MappedStream&) = delete;
+    MappedStream& operator=(const MappedStream&) = delete;
+
+    bool open(const QString& filename);
+
+    bool isOpen() const { return m_open; }
+    void close();
+
+private:
+    bool m_open;
+};
+
 }
 
 #endif
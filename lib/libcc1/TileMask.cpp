@@ -0,0 +1,196 @@
+/******************************************************************************
+ * This file is part of CCTools.                                              *
+ *                                                                            *
+ * CCTools is free software: you can redistribute it and/or modify            *
+ * it under the terms of the GNU General Public License as published by       *
+ * the Free Software Foundation, either version 3 of the License, or          *
+ * (at your option) any later version.                                        *
+ *                                                                            *
+ * CCTools is distributed in the hope that it will be useful,                 *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with CCTools.  If not, see <http://www.gnu.org/licenses/>.           *
+ ******************************************************************************/
+
+#include "TileMask.h"
+
+#if defined(__AVX2__)
+    #include <immintrin.h>
+    #define TILEMASK_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define TILEMASK_SSE2
+#endif
+
+static inline int popcount64(uint64_t value)
+{
+#if defined(__GNUC__)
+    return __builtin_popcountll(value);
+#else
+    value = value - ((value >> 1) & 0x5555555555555555ULL);
+    value = (value & 0x3333333333333333ULL) + ((value >> 2) & 0x3333333333333333ULL);
+    value = (value + (value >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (int)((value * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+static inline int lowestBit(uint64_t value)
+{
+#if defined(__GNUC__)
+    return __builtin_ctzll(value);
+#else
+    int bit = 0;
+    while ((value & 1) == 0) {
+        value >>= 1;
+        ++bit;
+    }
+    return bit;
+#endif
+}
+
+static inline int highestBit(uint64_t value)
+{
+#if defined(__GNUC__)
+    return 63 - __builtin_clzll(value);
+#else
+    int bit = 63;
+    while ((value & ((uint64_t)1 << 63)) == 0) {
+        value <<= 1;
+        --bit;
+    }
+    return bit;
+#endif
+}
+
+ccl::TileMask ccl::TileMask::fromLayer(const tile_t* layer, tile_t first, tile_t last)
+{
+    // A tile is in range when (tile - first) <= (last - first), using
+    // unsigned byte arithmetic.  min(x, span) == x tests x <= span.
+    TileMask mask;
+    const uint8_t span = (uint8_t)(last - first);
+
+#if defined(TILEMASK_AVX2)
+    const __m256i vfirst = _mm256_set1_epi8((char)first);
+    const __m256i vspan = _mm256_set1_epi8((char)span);
+    for (int word = 0; word < Words; ++word) {
+        const tile_t* src = layer + (word * 64);
+        __m256i lo = _mm256_sub_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src)), vfirst);
+        __m256i hi = _mm256_sub_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 32)), vfirst);
+        lo = _mm256_cmpeq_epi8(_mm256_min_epu8(lo, vspan), lo);
+        hi = _mm256_cmpeq_epi8(_mm256_min_epu8(hi, vspan), hi);
+        mask.m_bits[word] = (uint64_t)(uint32_t)_mm256_movemask_epi8(lo)
+                          | ((uint64_t)(uint32_t)_mm256_movemask_epi8(hi) << 32);
+    }
+#elif defined(TILEMASK_SSE2)
+    const __m128i vfirst = _mm_set1_epi8((char)first);
+    const __m128i vspan = _mm_set1_epi8((char)span);
+    for (int word = 0; word < Words; ++word) {
+        const tile_t* src = layer + (word * 64);
+        uint64_t bits = 0;
+        for (int part = 0; part < 4; ++part) {
+            __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + (part * 16)));
+            value = _mm_sub_epi8(value, vfirst);
+            value = _mm_cmpeq_epi8(_mm_min_epu8(value, vspan), value);
+            bits |= (uint64_t)(uint16_t)_mm_movemask_epi8(value) << (part * 16);
+        }
+        mask.m_bits[word] = bits;
+    }
+#else
+    for (int cell = 0; cell < Cells; ++cell) {
+        if ((uint8_t)(layer[cell] - first) <= span)
+            mask.m_bits[cell / 64] |= (uint64_t)1 << (cell % 64);
+    }
+#endif
+
+    return mask;
+}
+
+bool ccl::TileMask::any() const
+{
+    uint64_t bits = 0;
+    for (uint64_t word : m_bits)
+        bits |= word;
+    return bits != 0;
+}
+
+int ccl::TileMask::count() const
+{
+    int total = 0;
+    for (uint64_t word : m_bits)
+        total += popcount64(word);
+    return total;
+}
+
+int ccl::TileMask::first(int from) const
+{
+    if (from < 0)
+        from = 0;
+    if (from >= Cells)
+        return -1;
+
+    int word = from / 64;
+    uint64_t bits = m_bits[word] & (~(uint64_t)0 << (from % 64));
+    for ( ;; ) {
+        if (bits)
+            return (word * 64) + lowestBit(bits);
+        if (++word == Words)
+            return -1;
+        bits = m_bits[word];
+    }
+}
+
+int ccl::TileMask::last() const
+{
+    for (int word = Words - 1; word >= 0; --word) {
+        if (m_bits[word])
+            return (word * 64) + highestBit(m_bits[word]);
+    }
+    return -1;
+}
+
+ccl::TileMask ccl::TileMask::neighbors() const
+{
+    // Each 64-bit word holds two rows, so horizontal neighbors are a shift
+    // by one within the word (masking off cells that would wrap to another
+    // row), and vertical neighbors are a shift by half a word.
+    static const uint64_t notLeftColumn = ~0x0000000100000001ULL;
+    static const uint64_t notRightColumn = ~0x8000000080000000ULL;
+
+    TileMask result;
+    for (int word = 0; word < Words; ++word) {
+        const uint64_t bits = m_bits[word];
+        const uint64_t prev = (word > 0) ? m_bits[word - 1] : 0;
+        const uint64_t next = (word < Words - 1) ? m_bits[word + 1] : 0;
+
+        uint64_t adjacent = ((bits << 1) & notLeftColumn) | ((bits >> 1) & notRightColumn);
+        adjacent |= (bits << 32) | (prev >> 32);     // Cell above is set
+        adjacent |= (bits >> 32) | (next << 32);     // Cell below is set
+        result.m_bits[word] = adjacent;
+    }
+    return result;
+}
+
+ccl::TileMask& ccl::TileMask::operator|=(const TileMask& other)
+{
+    for (int word = 0; word < Words; ++word)
+        m_bits[word] |= other.m_bits[word];
+    return *this;
+}
+
+ccl::TileMask& ccl::TileMask::operator&=(const TileMask& other)
+{
+    for (int word = 0; word < Words; ++word)
+        m_bits[word] &= other.m_bits[word];
+    return *this;
+}
+
+ccl::TileMask ccl::TileMask::operator~() const
+{
+    TileMask result;
+    for (int word = 0; word < Words; ++word)
+        result.m_bits[word] = ~m_bits[word];
+    return result;
+}
@@ -0,0 +1,79 @@
+/******************************************************************************
+ * This file is part of CCTools.                                              *
+ *                                                                            *
+ * CCTools is free software: you can redistribute it and/or modify            *
+ * it under the terms of the GNU General Public License as published by       *
+ * the Free Software Foundation, either version 3 of the License, or          *
+ * (at your option) any later version.                                        *
+ *                                                                            *
+ * CCTools is distributed in the hope that it will be useful,                 *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with CCTools.  If not, see <http://www.gnu.org/licenses/>.           *
+ ******************************************************************************/
+
+#ifndef _TILEMASK_H
+#define _TILEMASK_H
+
+#include "Stream.h"
+
+namespace ccl {
+
+/* A set of cells on a 32x32 level layer, stored as a 1024-bit bitboard.
+ * Cell (x, y) is bit (y * 32) + x, so iterating set bits in order walks
+ * the map in reading order. */
+class TileMask {
+public:
+    enum { Width = 32, Height = 32, Cells = Width * Height, Words = Cells / 64 };
+
+    TileMask() : m_bits() { }
+
+    // Cells in the layer whose tile is in the range [first, last]
+    static TileMask fromLayer(const tile_t* layer, tile_t first, tile_t last);
+
+    bool test(int x, int y) const
+    {
+        const int cell = (y * Width) + x;
+        return (m_bits[cell / 64] & ((uint64_t)1 << (cell % 64))) != 0;
+    }
+
+    void set(int x, int y)
+    {
+        const int cell = (y * Width) + x;
+        m_bits[cell / 64] |= (uint64_t)1 << (cell % 64);
+    }
+
+    bool any() const;
+    int count() const;
+
+    // Index of the first set cell at or after from, or -1 if there are none
+    int first(int from = 0) const;
+    // Index of the last set cell, or -1 if the mask is empty
+    int last() const;
+
+    // Cells orthogonally adjacent to any cell in this mask
+    TileMask neighbors() const;
+    bool isAdjacentTo(const TileMask& other) const
+    {
+        return (neighbors() & other).any();
+    }
+
+    TileMask& operator|=(const TileMask& other);
+    TileMask& operator&=(const TileMask& other);
+    TileMask operator|(const TileMask& other) const { return TileMask(*this) |= other; }
+    TileMask operator&(const TileMask& other) const { return TileMask(*this) &= other; }
+    TileMask operator~() const;
+
+    static int cellX(int cell) { return cell % Width; }
+    static int cellY(int cell) { return cell / Width; }
+
+private:
+    uint64_t m_bits[Words];
+};
+
+}
+
+#endif
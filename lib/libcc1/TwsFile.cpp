@@ -0,0 +1,155 @@
+/******************************************************************************
+ * This file is part of CCTools.                                              *
+ *                                                                            *
+ * CCTools is free software: you can redistribute it and/or modify            *
+ * it under the terms of the GNU General Public License as published by       *
+ * the Free Software Foundation, either version 3 of the License, or          *
+ * (at your option) any later version.                                        *
+ *                                                                            *
+ * CCTools is distributed in the hope that it will be useful,                 *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with CCTools.  If not, see <http://www.gnu.org/licenses/>.           *
+ ******************************************************************************/
+
+#include "TwsFile.h"
+
+#include "Errors.h"
+
+#define TWS_SIGNATURE   0x999B3335
+
+// Tile World direction indices.  The engines take a single direction, so
+// diagonal moves are replayed as their vertical component.
+static ccl::Direction twsDirection(int index)
+{
+    static const ccl::Direction directions[] = {
+        ccl::DirNorth, ccl::DirWest, ccl::DirSouth, ccl::DirEast,
+        ccl::DirNorth, ccl::DirSouth, ccl::DirNorth, ccl::DirSouth,
+    };
+    return directions[index & 0x07];
+}
+
+static uint32_t readLE32(const uint8_t* data)
+{
+    return (uint32_t)data[0] | ((uint32_t)data[1] << 8)
+         | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+static void decodeMoves(std::vector<ccl::TwsMove>& moves, const uint8_t* data,
+                        const uint8_t* end)
+{
+    // Each move is stored with the number of ticks since the previous move
+    // (minus one), in one of several packed formats
+    uint32_t when = (uint32_t)-1;
+    while (data < end) {
+        ccl::TwsMove move;
+        switch (data[0] & 0x03) {
+        case 0:
+            // Three moves, each 4 ticks apart
+            for (int shift = 2; shift < 8; shift += 2) {
+                when += 4;
+                move.tick = when;
+                move.dir = twsDirection((data[0] >> shift) & 0x03);
+                moves.push_back(move);
+            }
+            data += 1;
+            continue;
+        case 1:
+            move.dir = twsDirection((data[0] >> 2) & 0x07);
+            when += ((data[0] >> 5) & 0x07) + 1;
+            data += 1;
+            break;
+        case 2:
+            if (end - data < 2)
+                throw ccl::FormatError(ccl::RuntimeError::tr("Corrupt move data in solution file"));
+            move.dir = twsDirection((data[0] >> 2) & 0x07);
+            when += (((data[0] >> 5) & 0x07) | ((uint32_t)data[1] << 3)) + 1;
+            data += 2;
+            break;
+        default:
+            if (data[0] & 0x10) {
+                // Mouse moves; these can't be replayed by direction alone
+                const int extra = (data[0] >> 2) & 0x03;
+                if (end - data < 2 + extra)
+                    throw ccl::FormatError(ccl::RuntimeError::tr("Corrupt move data in solution file"));
+                uint32_t delta = (data[1] >> 6) & 0x03;
+                for (int i = 0; i < extra; ++i)
+                    delta |= (uint32_t)data[2 + i] << (2 + (i * 8));
+                move.dir = ccl::DirInvalid;
+                when += delta + 1;
+                data += 2 + extra;
+            } else {
+                if (end - data < 4)
+                    throw ccl::FormatError(ccl::RuntimeError::tr("Corrupt move data in solution file"));
+                move.dir = twsDirection((data[0] >> 2) & 0x03);
+                when += (((data[0] >> 5) & 0x07) | ((uint32_t)data[1] << 3)
+                         | ((uint32_t)data[2] << 11) | ((uint32_t)data[3] << 19)) + 1;
+                data += 4;
+            }
+            break;
+        }
+        move.tick = when;
+        moves.push_back(move);
+    }
+}
+
+void ccl::TwsFile::read(ccl::Stream* stream)
+{
+    m_solutions.clear();
+
+    if (stream->read32() != TWS_SIGNATURE)
+        throw ccl::FormatError(ccl::RuntimeError::tr("Invalid Tile World solution file"));
+    m_ruleset = stream->read8();
+    if (m_ruleset != RulesetLynxId && m_ruleset != RulesetMSId)
+        throw ccl::FormatError(ccl::RuntimeError::tr("Unsupported ruleset in solution file"));
+    stream->read16();   // Flags
+    const uint8_t extraSize = stream->read8();
+    stream->seek(extraSize, SEEK_CUR);
+
+    std::vector<uint8_t> record;
+    for ( ;; ) {
+        uint32_t size;
+        if (stream->read(&size, sizeof(size), 1) == 0)
+            break;
+        size = SWAP32(size);
+        if (size == 0)
+            continue;
+
+        if ((long)size > stream->size() - stream->tell())
+            throw ccl::FormatError(ccl::RuntimeError::tr("Unexpected end of solution file"));
+        record.resize(size);
+        if (stream->read(record.data(), 1, size) != size)
+            throw ccl::FormatError(ccl::RuntimeError::tr("Unexpected end of solution file"));
+        if (size < 6)
+            throw ccl::FormatError(ccl::RuntimeError::tr("Invalid solution record"));
+
+        // Level 0 holds the levelset's name, and records shorter than 16
+        // bytes only hold a password
+        TwsSolution solution;
+        solution.levelNum = record[0] | (record[1] << 8);
+        if (solution.levelNum == 0 || size < 16)
+            continue;
+
+        for (size_t i = 2; i < 6 && record[i] != 0; ++i)
+            solution.password.push_back((char)record[i]);
+        solution.flags = record[6];
+        solution.slideDir = record[7] & 0x07;
+        solution.stepping = (record[7] >> 3) & 0x07;
+        solution.seed = readLE32(&record[8]);
+        solution.totalTicks = readLE32(&record[12]);
+        decodeMoves(solution.moves, record.data() + 16, record.data() + size);
+        m_solutions.push_back(std::move(solution));
+    }
+}
+
+const ccl::TwsSolution* ccl::TwsFile::solution(int levelNum) const
+{
+    for (const TwsSolution& solution : m_solutions) {
+        if (solution.levelNum == levelNum)
+            return &solution;
+    }
+    return nullptr;
+}
@@ -0,0 +1,67 @@
+/******************************************************************************
+ * This file is part of CCTools.                                              *
+ *                                                                            *
+ * CCTools is free software: you can redistribute it and/or modify            *
+ * it under the terms of the GNU General Public License as published by       *
+ * the Free Software Foundation, either version 3 of the License, or          *
+ * (at your option) any later version.                                        *
+ *                                                                            *
+ * CCTools is distributed in the hope that it will be useful,                 *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with CCTools.  If not, see <http://www.gnu.org/licenses/>.           *
+ ******************************************************************************/
+
+#ifndef _TWSFILE_H
+#define _TWSFILE_H
+
+#include "GameEngine.h"
+
+namespace ccl {
+
+struct TwsMove {
+    uint32_t tick;
+    Direction dir;      // DirInvalid for moves the engines can't replay
+};
+
+struct TwsSolution {
+    TwsSolution()
+        : levelNum(), flags(), slideDir(), stepping(), seed(), totalTicks()
+    { }
+
+    int levelNum;
+    std::string password;
+    uint8_t flags;
+    uint8_t slideDir;       // Initial random force floor direction
+    uint8_t stepping;
+    uint32_t seed;
+    uint32_t totalTicks;
+    std::vector<TwsMove> moves;
+};
+
+/* Tile World solution file */
+class TwsFile {
+public:
+    TwsFile() : m_ruleset() { }
+
+    void read(Stream* stream);
+
+    Ruleset ruleset() const { return (m_ruleset == RulesetLynxId) ? RulesetLynx : RulesetMS; }
+    const std::vector<TwsSolution>& solutions() const { return m_solutions; }
+
+    // Returns NULL if the file has no solution for the level
+    const TwsSolution* solution(int levelNum) const;
+
+private:
+    enum { RulesetLynxId = 1, RulesetMSId = 2 };
+
+    uint8_t m_ruleset;
+    std::vector<TwsSolution> m_solutions;
+};
+
+}
+
+#endif
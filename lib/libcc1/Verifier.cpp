@@ -0,0 +1,167 @@
+/******************************************************************************
+ * This file is part of CCTools.                                              *
+ *                                                                            *
+ * CCTools is free software: you can redistribute it and/or modify            *
+ * it under the terms of the GNU General Public License as published by       *
+ * the Free Software Foundation, either version 3 of the License, or          *
+ * (at your option) any later version.                                        *
+ *                                                                            *
+ * CCTools is distributed in the hope that it will be useful,                 *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with CCTools.  If not, see <http://www.gnu.org/licenses/>.           *
+ ******************************************************************************/
+
+#include "Verifier.h"
+
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <algorithm>
+#include "Errors.h"
+
+// How long to keep running after the last recorded move, for slides and
+// other forced movement to finish
+#define REPLAY_GRACE_TICKS  (10 * ccl::GameEngine::TicksPerSecond)
+
+ccl::VerifyResult ccl::VerifySolution(Ruleset ruleset, const LevelData* level,
+                                      const TwsSolution& solution)
+{
+    VerifyResult result;
+    result.levelNum = solution.levelNum;
+    result.hasSolution = true;
+
+    std::unique_ptr<GameEngine> engine = GameEngine::create(ruleset);
+    engine->reset(level, solution.seed);
+
+    uint32_t limit = solution.totalTicks;
+    if (!solution.moves.empty())
+        limit = std::max(limit, solution.moves.back().tick);
+    limit += REPLAY_GRACE_TICKS;
+
+    // A recorded move is held until the engine acts on it, or until the
+    // next move comes due, since the player can't act on every tick
+    size_t next = 0;
+    Direction pending = DirInvalid;
+    while (engine->status() == GameRunning && engine->state().tick < limit) {
+        const uint32_t now = engine->state().tick;
+        while (next < solution.moves.size() && solution.moves[next].tick <= now)
+            pending = solution.moves[next++].dir;
+        engine->tick(pending);
+        if (engine->inputTaken())
+            pending = DirInvalid;
+    }
+
+    result.status = engine->status();
+    result.ticks = engine->state().tick;
+    const int ticksLeft = engine->timeLeft();
+    if (ticksLeft >= 0)
+        result.timeLeft = (ticksLeft + GameEngine::TicksPerSecond - 1) / GameEngine::TicksPerSecond;
+    return result;
+}
+
+namespace {
+
+// Each worker starts with a contiguous block of tasks and takes them from
+// the front; once it runs dry, it steals from the back of another worker's
+// block.  No tasks are added after starting, so a worker can exit as soon
+// as every queue is empty.
+class WorkStealingPool {
+public:
+    explicit WorkStealingPool(unsigned int threads) : m_queues(threads) { }
+
+    template <typename Func>
+    void run(int count, Func func)
+    {
+        const int threads = (int)m_queues.size();
+        for (int i = 0; i < threads; ++i) {
+            const int first = (int)(((int64_t)count * i) / threads);
+            const int last = (int)(((int64_t)count * (i + 1)) / threads);
+            for (int task = first; task < last; ++task)
+                m_queues[i].tasks.push_back(task);
+        }
+
+        auto worker = [this, func](int self) {
+            int task;
+            while (take(self, task))
+                func(task);
+        };
+        std::vector<std::thread> pool;
+        for (int i = 1; i < threads; ++i)
+            pool.emplace_back(worker, i);
+        worker(0);
+        for (std::thread& thread : pool)
+            thread.join();
+    }
+
+private:
+    struct Queue {
+        std::mutex lock;
+        std::deque<int> tasks;
+    };
+    std::vector<Queue> m_queues;
+
+    bool take(int self, int& task)
+    {
+        {
+            Queue& own = m_queues[self];
+            std::lock_guard<std::mutex> guard(own.lock);
+            if (!own.tasks.empty()) {
+                task = own.tasks.front();
+                own.tasks.pop_front();
+                return true;
+            }
+        }
+
+        const int threads = (int)m_queues.size();
+        for (int i = 1; i < threads; ++i) {
+            Queue& victim = m_queues[(self + i) % threads];
+            std::lock_guard<std::mutex> guard(victim.lock);
+            if (!victim.tasks.empty()) {
+                task = victim.tasks.back();
+                victim.tasks.pop_back();
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+}
+
+std::vector<ccl::VerifyResult> ccl::VerifyLevelset(const Levelset* levelset,
+                                                   const TwsFile& solutions,
+                                                   unsigned int threads)
+{
+    const int count = levelset->levelCount();
+    std::vector<VerifyResult> results(count);
+    if (count == 0)
+        return results;
+
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = std::min(threads, (unsigned int)count);
+
+    const Ruleset ruleset = solutions.ruleset();
+    WorkStealingPool pool(threads);
+    pool.run(count, [&](int index) {
+        VerifyResult& result = results[index];
+        result.levelNum = index + 1;
+        const TwsSolution* solution = solutions.solution(index + 1);
+        if (!solution)
+            return;
+
+        // Lazily loaded levels are decoded here, on the worker thread.  Each
+        // level is only touched by the one task that owns it.
+        try {
+            result = VerifySolution(ruleset, levelset->level(index), *solution);
+        } catch (const ccl::RuntimeError& err) {
+            result.hasSolution = true;
+            result.error = err.message();
+        }
+    });
+    return results;
+}
@@ -0,0 +1,58 @@
+/******************************************************************************
+ * This file is part of CCTools.                                              *
+ *                                                                            *
+ * CCTools is free software: you can redistribute it and/or modify            *
+ * it under the terms of the GNU General Public License as published by       *
+ * the Free Software Foundation, either version 3 of the License, or          *
+ * (at your option) any later version.                                        *
+ *                                                                            *
+ * CCTools is distributed in the hope that it will be useful,                 *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with CCTools.  If not, see <http://www.gnu.org/licenses/>.           *
+ ******************************************************************************/
+
+#ifndef _VERIFIER_H
+#define _VERIFIER_H
+
+#include <QString>
+#include "TwsFile.h"
+
+namespace ccl {
+
+struct VerifyResult {
+    VerifyResult()
+        : levelNum(), hasSolution(), status(GameRunning), ticks(), timeLeft(-1)
+    { }
+
+    int levelNum;
+    bool hasSolution;
+    GameStatus status;      // Status when the replay ended
+    uint32_t ticks;         // Ticks simulated
+    int timeLeft;           // Whole seconds left on the clock, -1 if untimed
+    QString error;          // Set if the level couldn't be loaded
+
+    bool solved() const { return hasSolution && status == GameWon; }
+};
+
+/* Replays one recorded solution against the level.  The engines don't
+ * reproduce Tile World's player timing, random number generator or initial
+ * slide and stepping state, and diagonal and mouse moves can't be replayed
+ * exactly.  A valid solution may therefore fail to reach the exit, and an
+ * invalid one may reach it. */
+VerifyResult VerifySolution(Ruleset ruleset, const LevelData* level,
+                            const TwsSolution& solution);
+
+// Replays every level's solution, one level per task on a work-stealing
+// pool.  A thread count of 0 uses one worker per hardware thread.  The
+// results are in level order.
+std::vector<VerifyResult> VerifyLevelset(const Levelset* levelset,
+                                         const TwsFile& solutions,
+                                         unsigned int threads = 0);
+
+}
+
+#endif
@@ -18,6 +18,9 @@
 #include "GameLogic.h"
 
 #include <QPoint>
+#include <unordered_set>
+#include <algorithm>
+#include <climits>
 
 #define TILE_DIR(dir)   (cc2::Tile::Direction)((dir) & 0x03)
 
@@ -530,9 +533,18 @@ QPoint cc2::AdvanceCreature(const QPoint& pos, MoveState state)
 
 void cc2::ToggleGreens(Map* map)
 {
+    static const std::vector<Tile::Type> toggleTypes = {
+        Tile::ToggleWall, Tile::ToggleFloor, Tile::GreenBomb, Tile::GreenChip,
+    };
+
     MapData& mapData = map->mapData();
+    const MapData& constData = mapData;
     for (int y = 0; y < mapData.height(); ++y) {
         for (int x = 0; x < mapData.width(); ++x) {
+            // Only give cells that change a private stack
+            if (!constData.tile(x, y).haveTile(toggleTypes))
+                continue;
+
             cc2::Tile* tile = &mapData.tile(x, y);
             while (tile) {
                 switch (tile->type()) {
@@ -556,3 +568,191 @@ void cc2::ToggleGreens(Map* map)
         }
     }
 }
+
+// CC2 sends creatures to the previous teleport of the same color in reading
+// order, wrapping around the map.  Red teleports also need to be wired
+// together, which isn't checked here.  Green teleports pick a destination
+// at random, and yellow teleports only take the player, so neither has a
+// path to follow.  The scanned cells are added to the dependencies.
+static int findTeleportExit(const cc2::MapData& map, int cell,
+                            std::vector<std::pair<int, int>>& depends)
+{
+    const int width = map.width();
+    const int numCells = width * map.height();
+    const int type = map.tile(cell % width, cell / width).bottom().type();
+    if (type != cc2::Tile::Teleport_Red && type != cc2::Tile::Teleport_Blue)
+        return -1;
+
+    for (int offset = 1; offset < numCells; ++offset) {
+        const int dest = (cell - offset + numCells) % numCells;
+        if (map.tile(dest % width, dest / width).bottom().type() == type) {
+            if (dest < cell) {
+                depends.emplace_back(dest, cell - 1);
+            } else {
+                depends.emplace_back(0, cell - 1);
+                depends.emplace_back(dest, numCells - 1);
+            }
+            return dest;
+        }
+    }
+    depends.emplace_back(0, numCells - 1);
+    return -1;
+}
+
+bool cc2::CreaturePaths::Entry::dependsOn(int cell) const
+{
+    auto iter = std::upper_bound(depends.begin(), depends.end(), std::make_pair(cell, INT_MAX));
+    return iter != depends.begin() && (iter - 1)->second >= cell;
+}
+
+void cc2::CreaturePaths::invalidate(int x, int y)
+{
+    const int cell = (y * m_width) + x;
+    auto iter = m_paths.begin();
+    while (iter != m_paths.end()) {
+        if (iter->second.dependsOn(cell))
+            iter = m_paths.erase(iter);
+        else
+            ++iter;
+    }
+}
+
+void cc2::CreaturePaths::invalidate(const MapData& before, const MapData& after)
+{
+    if (before.width() != after.width() || before.height() != after.height()
+            || after.width() != m_width || after.height() != m_height) {
+        m_paths.clear();
+        return;
+    }
+
+    std::vector<int> changed;
+    for (int y = 0; y < after.height(); ++y) {
+        if (after.sameRow(y, before))
+            continue;
+        for (int x = 0; x < after.width(); ++x) {
+            if (!after.sameTile(x, y, before))
+                changed.push_back((y * m_width) + x);
+        }
+    }
+    invalidateCells(changed);
+}
+
+void cc2::CreaturePaths::invalidate(const std::vector<QPoint>& cells)
+{
+    std::vector<int> changed;
+    changed.reserve(cells.size());
+    for (const QPoint& cell : cells) {
+        if (cell.x() < m_width && cell.y() < m_height)
+            changed.push_back((cell.y() * m_width) + cell.x());
+    }
+    std::sort(changed.begin(), changed.end());
+    invalidateCells(changed);
+}
+
+void cc2::CreaturePaths::invalidateCells(const std::vector<int>& changed)
+{
+    if (changed.empty())
+        return;
+
+    // Both lists are sorted, so each path is checked in a single merge pass
+    auto iter = m_paths.begin();
+    while (iter != m_paths.end()) {
+        const std::vector<std::pair<int, int>>& depends = iter->second.depends;
+        auto cell = changed.begin();
+        auto range = depends.begin();
+        bool affected = false;
+        while (cell != changed.end() && range != depends.end()) {
+            if (*cell < range->first) {
+                ++cell;
+            } else if (*cell > range->second) {
+                ++range;
+            } else {
+                affected = true;
+                break;
+            }
+        }
+        if (affected)
+            iter = m_paths.erase(iter);
+        else
+            ++iter;
+    }
+}
+
+const cc2::CreaturePaths::Path& cc2::CreaturePaths::path(const MapData& map, const Tile* creature,
+                                                         int x, int y, int index)
+{
+    if (map.width() != m_width || map.height() != m_height) {
+        m_paths.clear();
+        m_width = map.width();
+        m_height = map.height();
+    }
+
+    const uint32_t key = ((uint32_t)((y * m_width) + x) << 4) | (uint32_t)(index & 0x0F);
+    auto iter = m_paths.find(key);
+    if (iter != m_paths.end())
+        return iter->second.path;
+
+    Entry& entry = m_paths[key];
+    trace(entry, map, creature, x, y);
+    return entry.path;
+}
+
+void cc2::CreaturePaths::trace(Entry& entry, const MapData& map, const Tile* creature,
+                               int x, int y)
+{
+    // Cells and directions the creature has already been through, sized to
+    // the path rather than to the map
+    std::unordered_set<int> looked;
+    auto lookedKey = [this](const QPoint& pos, const Tile& tile) {
+        return (((pos.y() * m_width) + pos.x()) << 2) | (int)tile.direction();
+    };
+
+    Tile tmpCre(*creature);
+    QPoint from(x, y);
+    MoveState move = CheckMove(map, &tmpCre, from.x(), from.y());
+    entry.path.runs.emplace_back(1, from);
+
+    for ( ;; ) {
+        // CheckMove() looks at the creature's cell and its neighbors
+        const int cell = (from.y() * m_width) + from.x();
+        entry.depends.emplace_back(cell - 1, cell + 1);
+        entry.depends.emplace_back(cell - m_width, cell - m_width);
+        entry.depends.emplace_back(cell + m_width, cell + m_width);
+
+        looked.insert(lookedKey(from, tmpCre));
+        if ((move & MoveDirMask) >= MoveBlocked || (move & MoveTrapped) != 0)
+            break;
+
+        QPoint to = AdvanceCreature(from, move);
+        entry.path.runs.back().push_back(to);
+        if ((move & MoveDeath) != 0)
+            break;
+        TurnCreature(&tmpCre, move);
+        if ((move & MoveTeleport) != 0) {
+            const int dest = findTeleportExit(map, (to.y() * m_width) + to.x(), entry.depends);
+            if (dest < 0)
+                break;
+            to = QPoint(dest % m_width, dest / m_width);
+            entry.path.runs.emplace_back(1, to);
+        }
+        from = to;
+
+        move = CheckMove(map, &tmpCre, from.x(), from.y());
+        if (looked.count(lookedKey(from, tmpCre)))
+            break;
+    }
+
+    // Sort and merge the dependencies, so they can be binary searched
+    std::vector<std::pair<int, int>>& depends = entry.depends;
+    std::sort(depends.begin(), depends.end());
+    size_t merged = 0;
+    for (size_t i = 1; i < depends.size(); ++i) {
+        if (depends[i].first <= depends[merged].second + 1)
+            depends[merged].second = std::max(depends[merged].second, depends[i].second);
+        else
+            depends[++merged] = depends[i];
+    }
+    if (!depends.empty())
+        depends.resize(merged + 1);
+    depends.shrink_to_fit();
+}
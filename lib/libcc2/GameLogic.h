@@ -20,6 +20,9 @@
 
 #include "Map.h"
 
+#include <QPoint>
+#include <unordered_map>
+
 namespace cc2 {
 
 enum MoveState {
@@ -42,6 +45,49 @@ QPoint AdvanceCreature(const QPoint& pos, MoveState state);
 
 void ToggleGreens(Map* map);
 
+/* Cache of the paths creatures would follow from their starting positions.
+ * Each path records the cells that tracing it looked at, so a change to
+ * the map only retraces the paths that could have been affected. */
+class CreaturePaths {
+public:
+    struct Path {
+        // Each run is one polyline; following a teleport starts a new run
+        std::vector<std::vector<QPoint>> runs;
+    };
+
+    CreaturePaths() : m_width(), m_height() { }
+
+    void clear() { m_paths.clear(); }
+
+    // The tile(s) at (x, y) changed
+    void invalidate(int x, int y);
+
+    // Invalidates paths affected by any cell that differs between the maps
+    void invalidate(const MapData& before, const MapData& after);
+
+    // Invalidates paths affected by any of the cells
+    void invalidate(const std::vector<QPoint>& cells);
+
+    // Path of a creature at (x, y), which is the index'th creature in the
+    // cell's stack (counting from the top).  Traced on first use.
+    const Path& path(const MapData& map, const Tile* creature, int x, int y, int index);
+
+private:
+    struct Entry {
+        Path path;
+        // Sorted, non-overlapping [first, last] ranges of cell indices
+        std::vector<std::pair<int, int>> depends;
+
+        bool dependsOn(int cell) const;
+    };
+
+    std::unordered_map<uint32_t, Entry> m_paths;
+    int m_width, m_height;
+
+    void trace(Entry& entry, const MapData& map, const Tile* creature, int x, int y);
+    void invalidateCells(const std::vector<int>& changed);
+};
+
 }
 
 #endif
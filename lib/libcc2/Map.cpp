@@ -99,36 +99,51 @@ void cc2::MapOption::write(ccl::Stream* stream) const
 
 cc2::Tile::Tile(const Tile& copy)
     : m_type(copy.m_type), m_direction(copy.m_direction),
-      m_tileFlags(copy.m_tileFlags), m_modifier(copy.m_modifier), m_lower()
+      m_tileFlags(copy.m_tileFlags), m_below(Standalone),
+      m_modifier(copy.m_modifier), m_lower()
 {
     auto lower = checkLower();
-    if (lower && copy.m_lower)
-        lower->operator=(*copy.m_lower);
+    if (lower && copy.lower())
+        lower->operator=(*copy.lower());
 }
 
 cc2::Tile& cc2::Tile::operator=(const Tile& copy)
 {
+    // Check up front, so a failed copy leaves the stack unchanged
+    if (m_below != Standalone && copy.layerCount() > m_below + 1)
+        tooManyLayers();
+
     m_type = copy.m_type;
     m_direction = copy.m_direction;
     m_tileFlags = copy.m_tileFlags;
     m_modifier = copy.m_modifier;
     auto lower = checkLower();
-    if (lower && copy.m_lower)
-        lower->operator=(*copy.m_lower);
+    if (lower && copy.lower())
+        lower->operator=(*copy.lower());
 
     return *this;
 }
 
 cc2::Tile::Tile(Tile&& move) noexcept
     : m_type(move.m_type), m_direction(move.m_direction),
-      m_tileFlags(move.m_tileFlags), m_modifier(move.m_modifier),
-      m_lower(move.m_lower)
+      m_tileFlags(move.m_tileFlags), m_below(Standalone),
+      m_modifier(move.m_modifier), m_lower()
 {
-    move.m_lower = nullptr;
+    if (move.m_below == Standalone) {
+        std::swap(m_lower, move.m_lower);
+    } else {
+        // Records in a map's arena can't give up their layers
+        auto lower = checkLower();
+        if (lower && move.lower())
+            lower->operator=(*move.lower());
+    }
 }
 
-cc2::Tile& cc2::Tile::operator=(Tile&& move) noexcept
+cc2::Tile& cc2::Tile::operator=(Tile&& move)
 {
+    if (m_below != Standalone || move.m_below != Standalone)
+        return operator=(static_cast<const Tile&>(move));
+
     m_type = move.m_type;
     m_direction = move.m_direction;
     m_tileFlags = move.m_tileFlags;
@@ -175,6 +190,8 @@ void cc2::Tile::read(ccl::Stream* stream)
     if (m_type == PanelCanopy || m_type == DirBlock)
         m_tileFlags = stream->read8();
 
+    if (haveLower() && m_below == 0)
+        throw ccl::FormatError(ccl::RuntimeError::tr("Too many layers in map tile"));
     auto nextLayer = checkLower();
     if (nextLayer)
         nextLayer->read(stream);
@@ -201,8 +218,8 @@ void cc2::Tile::write(ccl::Stream* stream) const
         stream->write8(m_tileFlags);
 
     if (haveLower()) {
-        Q_ASSERT(m_lower);
-        m_lower->write(stream);
+        Q_ASSERT(lower());
+        lower()->write(stream);
     }
 }
 
@@ -762,39 +779,334 @@ cc2::Tile* cc2::Tile::checkLower()
 {
     if (!haveLower())
         return nullptr;
+    if (m_below != Standalone) {
+        if (m_below == 0)
+            tooManyLayers();
+        return this + 1;
+    }
     if (!m_lower)
         m_lower = new Tile;
     return m_lower;
 }
 
+void cc2::Tile::tooManyLayers()
+{
+    throw ccl::RuntimeError(ccl::RuntimeError::tr("Too many layers in map tile"));
+}
 
-cc2::MapData::MapData(const MapData& other)
-    : m_width(other.m_width), m_height(other.m_height), m_map()
+
+static void resetRecord(cc2::Tile* record)
+{
+    record->setType(cc2::Tile::Floor);
+    record->setDirection(cc2::Tile::North);
+    record->setTileFlags(0);
+    record->setModifier(0);
+}
+
+static size_t hashStack(const cc2::Tile* stack)
+{
+    uint64_t hash = 0;
+    for (const cc2::Tile* layer = stack; layer; layer = layer->lower()) {
+        const uint64_t value = ((uint64_t)layer->type() << 56)
+                             | ((uint64_t)(layer->direction() & 0xFF) << 48)
+                             | ((uint64_t)layer->tileFlags() << 40)
+                             | layer->modifier();
+        hash = (hash ^ value) * 0x100000001B3ULL;
+        hash ^= hash >> 29;
+    }
+    return (size_t)hash;
+}
+
+cc2::TileStore::TileStore()
+{
+    for (int i = 0; i < MaxLayers; ++i)
+        m_scratch[i].m_below = (uint8_t)(MaxLayers - 1 - i);
+
+    const uint32_t floor = intern(allocate());
+    Q_ASSERT(floor == FloorStack);
+    (void)floor;
+}
+
+cc2::TileStore::~TileStore()
+{
+    for (Tile* block : m_blocks)
+        delete[] block;
+}
+
+uint32_t cc2::TileStore::allocate()
+{
+    uint32_t handle;
+    if (!m_free.empty()) {
+        handle = m_free.back();
+        m_free.pop_back();
+        Tile* records = stack(handle);
+        for (int i = 0; i < MaxLayers; ++i)
+            resetRecord(&records[i]);
+    } else {
+        handle = (uint32_t)m_interned.size();
+        if (handle % BlockStacks == 0) {
+            Tile* block = new Tile[BlockStacks * MaxLayers];
+            for (int i = 0; i < BlockStacks * MaxLayers; ++i)
+                block[i].m_below = (uint8_t)(MaxLayers - 1 - (i % MaxLayers));
+            m_blocks.push_back(block);
+        }
+        m_interned.push_back(false);
+    }
+    return handle;
+}
+
+uint32_t cc2::TileStore::detach(uint32_t handle)
+{
+    const uint32_t copy = allocate();
+    // The records don't link to each other, so copying them doesn't need
+    // to follow the layers
+    const Tile* src = stack(handle);
+    Tile* dest = stack(copy);
+    for (int i = 0; i < MaxLayers; ++i) {
+        dest[i].m_type = src[i].m_type;
+        dest[i].m_direction = src[i].m_direction;
+        dest[i].m_tileFlags = src[i].m_tileFlags;
+        dest[i].m_modifier = src[i].m_modifier;
+    }
+    return copy;
+}
+
+void cc2::TileStore::release(uint32_t handle)
+{
+    Q_ASSERT(!m_interned[handle]);
+    m_free.push_back(handle);
+}
+
+int cc2::TileStore::stackDepth(const Tile* records)
+{
+    int depth = 1;
+    for (const Tile* layer = records->lower(); layer; layer = layer->lower())
+        ++depth;
+    return depth;
+}
+
+uint32_t cc2::TileStore::find(const Tile* records, size_t hash) const
+{
+    auto range = m_index.equal_range(hash);
+    for (auto iter = range.first; iter != range.second; ++iter) {
+        if (*stack(iter->second) == *records)
+            return iter->second;
+    }
+    return (uint32_t)-1;
+}
+
+uint32_t cc2::TileStore::intern(uint32_t handle)
 {
-    if (other.m_map) {
-        const size_t mapSize = m_width * m_height;
-        m_map = new Tile[mapSize];
-        for (size_t i = 0; i < mapSize; ++i)
-            m_map[i] = other.m_map[i];
+    Q_ASSERT(!m_interned[handle]);
+
+    // Clear anything left below the bottom layer, so equal stacks have
+    // equal records
+    Tile* records = stack(handle);
+    for (int i = stackDepth(records); i < MaxLayers; ++i)
+        resetRecord(&records[i]);
+
+    const size_t hash = hashStack(records);
+    const uint32_t existing = find(records, hash);
+    if (existing != (uint32_t)-1) {
+        release(handle);
+        return existing;
     }
+
+    m_interned[handle] = true;
+    m_index.emplace(hash, handle);
+    return handle;
+}
+
+// How each tile type is encoded in map data
+enum LayerFormat {
+    LayerModifier8 = 0x01,
+    LayerModifier16 = 0x02,
+    LayerModifier32 = 0x04,
+    LayerDirection = 0x08,
+    LayerTileFlags = 0x10,
+    LayerLower = 0x20,
+    LayerModifier = LayerModifier8 | LayerModifier16 | LayerModifier32,
+};
+
+static const uint8_t* layerFormats()
+{
+    struct FormatTable {
+        uint8_t formats[256];
+
+        FormatTable()
+        {
+            for (int type = 0; type < 256; ++type) {
+                uint8_t format = 0;
+                if (cc2::Tile::haveDirection(type))
+                    format |= LayerDirection;
+                if (type == cc2::Tile::PanelCanopy || type == cc2::Tile::DirBlock)
+                    format |= LayerTileFlags;
+                if (cc2::Tile::haveLower(type))
+                    format |= LayerLower;
+                formats[type] = format;
+            }
+            formats[cc2::Tile::Modifier8] = LayerModifier8;
+            formats[cc2::Tile::Modifier16] = LayerModifier16;
+            formats[cc2::Tile::Modifier32] = LayerModifier32;
+        }
+    };
+    static const FormatTable table;
+    return table.formats;
+}
+
+uint32_t cc2::TileStore::decode(const uint8_t*& data, const uint8_t* end)
+{
+    // Only the layers that were decoded need to be cleared for the next stack
+    struct ScratchReset {
+        Tile* records;
+        ~ScratchReset()
+        {
+            Tile* record = records;
+            while (record) {
+                Tile* lower = record->lower();
+                resetRecord(record);
+                record = lower;
+            }
+        }
+    } reset { m_scratch };
+
+    const uint8_t* formats = layerFormats();
+    const uint8_t* bp = data;
+    for (int layer = 0; ; ++layer) {
+        Tile& record = m_scratch[layer];
+        if (bp == end)
+            throw ccl::IOError(ccl::RuntimeError::tr("Read past end of stream"));
+        uint8_t format = formats[*bp];
+        if (format & LayerModifier) {
+            // The modifier's size in bytes matches its format bit
+            const size_t modifierSize = format & LayerModifier;
+            if ((size_t)(end - bp) < modifierSize + 2)
+                throw ccl::IOError(ccl::RuntimeError::tr("Read past end of stream"));
+            ++bp;
+            uint32_t modifier = 0;
+            for (size_t i = 0; i < modifierSize; ++i)
+                modifier |= (uint32_t)bp[i] << (i * 8);
+            record.m_modifier = modifier;
+            bp += modifierSize;
+
+            // A second modifier is just an (invalid) tile type
+            format = formats[*bp] & ~LayerModifier;
+        }
+        record.m_type = *bp++;
+
+        const size_t extra = ((format & LayerDirection) ? 1 : 0)
+                           + ((format & LayerTileFlags) ? 1 : 0);
+        if ((size_t)(end - bp) < extra)
+            throw ccl::IOError(ccl::RuntimeError::tr("Read past end of stream"));
+        if (format & LayerDirection)
+            record.m_direction = *bp++;
+        if (format & LayerTileFlags)
+            record.m_tileFlags = *bp++;
+
+        if (!(format & LayerLower))
+            break;
+        if (layer + 1 == MaxLayers)
+            throw ccl::FormatError(ccl::RuntimeError::tr("Too many layers in map tile"));
+    }
+    data = bp;
+
+    const size_t hash = hashStack(m_scratch);
+    uint32_t handle = find(m_scratch, hash);
+    if (handle != (uint32_t)-1)
+        return handle;
+
+    handle = allocate();
+    Tile* records = stack(handle);
+    const int depth = stackDepth(m_scratch);
+    for (int i = 0; i < depth; ++i) {
+        records[i].m_type = m_scratch[i].m_type;
+        records[i].m_direction = m_scratch[i].m_direction;
+        records[i].m_tileFlags = m_scratch[i].m_tileFlags;
+        records[i].m_modifier = m_scratch[i].m_modifier;
+    }
+    m_interned[handle] = true;
+    m_index.emplace(hash, handle);
+    return handle;
+}
+
+
+cc2::MapData::MapData(const MapData& other)
+    : m_width(other.m_width), m_height(other.m_height)
+{
+    other.internCells();
+    m_rows = other.m_rows;
+    m_store = other.m_store;
 }
 
 cc2::MapData& cc2::MapData::operator=(const MapData& other)
 {
-    delete[] m_map;
+    if (this == &other)
+        return *this;
+
+    releaseCells();
+    other.internCells();
     m_width = other.m_width;
     m_height = other.m_height;
-    if (other.m_map) {
-        const size_t mapSize = m_width * m_height;
-        m_map = new Tile[mapSize];
-        for (size_t i = 0; i < mapSize; ++i)
-            m_map[i] = other.m_map[i];
-    } else {
-        m_map = nullptr;
-    }
+    m_rows = other.m_rows;
+    m_store = other.m_store;
     return *this;
 }
 
+void cc2::MapData::internRow(int y) const
+{
+    Row& row = *m_rows[y];
+    if (!row.edited)
+        return;
+    for (uint32_t& handle : row.cells) {
+        if (!m_store->isInterned(handle))
+            handle = m_store->intern(handle);
+    }
+    row.edited = false;
+}
+
+void cc2::MapData::releaseRow(int y)
+{
+    Row& row = *m_rows[y];
+    if (!row.edited)
+        return;
+    for (uint32_t handle : row.cells) {
+        if (!m_store->isInterned(handle))
+            m_store->release(handle);
+    }
+    row.edited = false;
+}
+
+void cc2::MapData::internCells() const
+{
+    for (int y = 0; y < m_height; ++y)
+        internRow(y);
+}
+
+void cc2::MapData::releaseCells()
+{
+    for (int y = 0; y < m_height; ++y)
+        releaseRow(y);
+}
+
+bool cc2::MapData::sameTile(int x, int y, const MapData& other) const
+{
+    if (x >= m_width || y >= m_height || x >= other.m_width || y >= other.m_height)
+        throw std::out_of_range("Map index out of bounds");
+
+    if (m_rows[y] == other.m_rows[y])
+        return true;
+
+    const uint32_t handle = m_rows[y]->cells[x];
+    const uint32_t otherHandle = other.m_rows[y]->cells[x];
+    if (m_store == other.m_store) {
+        if (handle == otherHandle)
+            return true;
+        if (m_store->isInterned(handle) && m_store->isInterned(otherHandle))
+            return false;
+    }
+    return tile(x, y) == other.tile(x, y);
+}
+
 void cc2::MapData::copyFrom(const MapData& source, int srcX, int srcY,
                             int destX, int destY, int width, int height)
 {
@@ -806,9 +1118,33 @@ void cc2::MapData::copyFrom(const MapData& source, int srcX, int srcY,
     width = std::min({width, m_width - destX, source.m_width - srcX});
     height = std::min({height, m_height - destY, source.m_height - srcY});
 
-    for (int x = 0; x < width; ++x) {
-        for (int y = 0; y < height; ++y)
-            tile(x + destX, y + destY) = source.tile(x + srcX, y + srcY);
+    for (int y = 0; y < height; ++y) {
+        // Whole rows of the same map can simply be shared
+        if (width == m_width && width == source.m_width && m_store == source.m_store) {
+            source.internRow(y + srcY);
+            releaseRow(y + destY);
+            m_rows[y + destY] = source.m_rows[y + srcY];
+            continue;
+        }
+
+        for (int x = 0; x < width; ++x) {
+            uint32_t& srcHandle = source.m_rows[y + srcY]->cells[x + srcX];
+            uint32_t newHandle;
+            if (source.m_store == m_store) {
+                if (!m_store->isInterned(srcHandle))
+                    srcHandle = m_store->intern(srcHandle);
+                newHandle = srcHandle;
+            } else {
+                newHandle = m_store->allocate();
+                *m_store->stack(newHandle) = *source.m_store->stack(srcHandle);
+                newHandle = m_store->intern(newHandle);
+            }
+
+            uint32_t& handle = editRow(y + destY).cells[x + destX];
+            if (!m_store->isInterned(handle))
+                m_store->release(handle);
+            handle = newHandle;
+        }
     }
 }
 
@@ -1041,14 +1377,18 @@ void cc2::MapData::importFrom(const ccl::LevelData* level, bool autoResize)
                 *lower = mapCC1Tile(level->map().getBG(x, y), chipsLeft);
         }
     }
+    internCells();
 
     if (autoResize) {
-        const Tile blankTile;
+        // All cells are interned, so blank cells have the Floor handle
+        auto blankTile = [this](int x, int y) {
+            return m_rows[y]->cells[x] == TileStore::FloorStack;
+        };
         int blankRows = 0;
         for (int y = 0; y < m_height; ++y, ++blankRows) {
             bool rowEmpty = true;
             for (int x = 0; rowEmpty && x < m_width; ++x) {
-                if (tile(x, y) != blankTile)
+                if (!blankTile(x, y))
                     rowEmpty = false;
             }
             if (!rowEmpty)
@@ -1056,10 +1396,8 @@ void cc2::MapData::importFrom(const ccl::LevelData* level, bool autoResize)
         }
         if (blankRows) {
             // Move tiles up blankCount rows
-            for (int y = 0; y < m_height - blankRows; ++y) {
-                for (int x = 0; x < m_width; ++x)
-                    tile(x, y) = tile(x, y + blankRows);
-            }
+            for (int y = 0; y < m_height - blankRows; ++y)
+                m_rows[y] = m_rows[y + blankRows];
             resize(m_width, m_height - blankRows);
         }
 
@@ -1067,7 +1405,7 @@ void cc2::MapData::importFrom(const ccl::LevelData* level, bool autoResize)
         for (int x = 0; x < m_width; ++x, ++blankCols) {
             bool colEmpty = true;
             for (int y = 0; colEmpty && y < m_height; ++y) {
-                if (tile(x, y) != blankTile)
+                if (!blankTile(x, y))
                     colEmpty = false;
             }
             if (!colEmpty)
@@ -1075,9 +1413,9 @@ void cc2::MapData::importFrom(const ccl::LevelData* level, bool autoResize)
         }
         if (blankCols) {
             // Move tiles left blankCount columns
-            for (int x = 0; x < m_width - blankCols; ++x) {
-                for (int y = 0; y < m_height; ++y)
-                    tile(x, y) = tile(x + blankCols, y);
+            for (int y = 0; y < m_height; ++y) {
+                std::vector<uint32_t>& cells = editRow(y).cells;
+                std::move(cells.begin() + blankCols, cells.end(), cells.begin());
             }
             resize(m_width - blankCols, m_height);
         }
@@ -1087,7 +1425,7 @@ void cc2::MapData::importFrom(const ccl::LevelData* level, bool autoResize)
         for (int y = m_height - 1; y > 0; --y, ++blankRows) {
             bool rowEmpty = true;
             for (int x = 0; rowEmpty && x < m_width; ++x) {
-                if (tile(x, y) != blankTile)
+                if (!blankTile(x, y))
                     rowEmpty = false;
             }
             if (!rowEmpty)
@@ -1096,7 +1434,7 @@ void cc2::MapData::importFrom(const ccl::LevelData* level, bool autoResize)
         for (int x = m_width - 1; x > 0; --x, ++blankCols) {
             bool colEmpty = true;
             for (int y = 0; colEmpty && y < m_height; ++y) {
-                if (tile(x, y) != blankTile)
+                if (!blankTile(x, y))
                     colEmpty = false;
             }
             if (!colEmpty)
@@ -1110,50 +1448,101 @@ void cc2::MapData::importFrom(const ccl::LevelData* level, bool autoResize)
 
 void cc2::MapData::read(ccl::Stream* stream, size_t size)
 {
-    long start = stream->tell();
+    // Tiles are decoded from the rest of the stream, not just the field, so
+    // that an overrun is reported the same way as by the byte-at-a-time
+    // reader: a parse failure if more data follows, or a read error at the
+    // end of the stream.  Decode from the bytes in place if they are already
+    // in memory, otherwise pull them in with a single read.
+    const long available = std::max(stream->size() - stream->tell(), 0L);
+    const uint8_t* data = stream->buffer();
+    std::unique_ptr<uint8_t[]> dataCopy;
+    if (data) {
+        data += stream->tell();
+    } else {
+        dataCopy.reset(new uint8_t[available]);
+        if (stream->read(dataCopy.get(), 1, available) != (size_t)available)
+            throw ccl::IOError(ccl::RuntimeError::tr("Read past end of stream"));
+        data = dataCopy.get();
+    }
+    const uint8_t* const start = data;
+    const uint8_t* const end = data + available;
 
-    delete[] m_map;
-    m_width = stream->read8();
-    m_height = stream->read8();
-    const size_t mapSize = m_width * m_height;
-    m_map = new Tile[mapSize];
-    for (size_t i = 0; i < mapSize; ++i)
-        m_map[i].read(stream);
+    resize(0, 0);
+    if (available < 2)
+        throw ccl::IOError(ccl::RuntimeError::tr("Read past end of stream"));
+    resize(data[0], data[1]);
+    data += 2;
+
+    // Neighboring cells often hold the same tiles, which can be recognized
+    // from their encoding without decoding them again
+    const uint8_t* last = nullptr;
+    size_t lastSize = 0;
+    uint32_t lastHandle = TileStore::FloorStack;
+    for (const std::shared_ptr<Row>& row : m_rows) {
+        for (uint32_t& handle : row->cells) {
+            if (last && (size_t)(end - data) >= lastSize
+                    && memcmp(data, last, lastSize) == 0) {
+                handle = lastHandle;
+                data += lastSize;
+                continue;
+            }
+            last = data;
+            handle = m_store->decode(data, end);
+            lastSize = (size_t)(data - last);
+            lastHandle = handle;
+        }
+    }
 
-    if (start + (long)size != stream->tell())
+    if ((size_t)(data - start) != size)
         throw ccl::FormatError(ccl::RuntimeError::tr("Failed to parse map data"));
+    stream->seek(dataCopy ? (long)size - available : (long)size, SEEK_CUR);
 }
 
 void cc2::MapData::write(ccl::Stream* stream) const
 {
     stream->write8(m_width);
     stream->write8(m_height);
-    for (size_t i = 0; i < (size_t)(m_width * m_height); ++i)
-        m_map[i].write(stream);
+    for (const std::shared_ptr<Row>& row : m_rows) {
+        for (uint32_t handle : row->cells)
+            m_store->stack(handle)->write(stream);
+    }
 }
 
 void cc2::MapData::resize(uint8_t width, uint8_t height)
 {
     if (width == 0 || height == 0) {
-        delete[] m_map;
-        m_map = nullptr;
+        releaseCells();
+        m_rows.clear();
         m_width = 0;
         m_height = 0;
         return;
     }
 
-    Tile* newMap = new Tile[width * height];
-
-    // Copy the old map if possible
-    uint8_t copyWidth = std::min(m_width, width);
-    uint8_t copyHeight = std::min(m_height, height);
-    for (uint8_t y = 0; y < copyHeight; ++y) {
-        for (uint8_t x = 0; x < copyWidth; ++x)
-            newMap[(y * width) + x] = m_map[(y * m_width) + x];
+    if (!m_store)
+        m_store = std::make_shared<TileStore>();
+
+    // Keep the old map's rows if possible
+    for (uint8_t y = height; y < m_height; ++y)
+        releaseRow(y);
+    m_rows.resize(height);
+    for (uint8_t y = 0; y < height; ++y) {
+        if (y < m_height && width == m_width)
+            continue;
+
+        auto row = std::make_shared<Row>(width);
+        if (y < m_height) {
+            const std::vector<uint32_t>& cells = m_rows[y]->cells;
+            for (uint8_t x = 0; x < std::min(width, m_width); ++x)
+                row->cells[x] = cells[x];
+            for (uint8_t x = width; x < m_width; ++x) {
+                if (!m_store->isInterned(cells[x]))
+                    m_store->release(cells[x]);
+            }
+            row->edited = m_rows[y]->edited;
+        }
+        m_rows[y] = std::move(row);
     }
 
-    delete[] m_map;
-    m_map = newMap;
     m_width = width;
     m_height = height;
 }
@@ -1182,11 +1571,13 @@ static std::tuple<int, int> tileChips(const cc2::Tile* tile)
 std::tuple<int, int> cc2::MapData::countChips() const
 {
     auto chips = std::make_tuple(0, 0);
-    const Tile* mapEnd = m_map + (m_width * m_height);
-    for (const Tile* tp = m_map; tp != mapEnd; ++tp) {
-        const std::tuple<int, int> tc = tileChips(tp);
-        std::get<0>(chips) += std::get<0>(tc);
-        std::get<1>(chips) += std::get<1>(tc);
+    for (const std::shared_ptr<Row>& row : m_rows) {
+        for (uint32_t handle : row->cells) {
+            const Tile* tp = m_store->stack(handle);
+            const std::tuple<int, int> tc = tileChips(tp);
+            std::get<0>(chips) += std::get<0>(tc);
+            std::get<1>(chips) += std::get<1>(tc);
+        }
     }
     return chips;
 }
@@ -1220,17 +1611,25 @@ std::tuple<int, int> cc2::MapData::countPoints() const
 {
     // Raw points and multiplier
     auto points = std::make_tuple(0, 0);
-    const Tile* mapEnd = m_map + (m_width * m_height);
-    for (const Tile* tp = m_map; tp != mapEnd; ++tp) {
-        auto p = tilePoints(tp);
-        std::get<0>(points) += std::get<0>(p);
-        std::get<1>(points) += std::get<1>(p);
+    for (const std::shared_ptr<Row>& row : m_rows) {
+        for (uint32_t handle : row->cells) {
+            const Tile* tp = m_store->stack(handle);
+            auto p = tilePoints(tp);
+            std::get<0>(points) += std::get<0>(p);
+            std::get<1>(points) += std::get<1>(p);
+        }
     }
     return points;
 }
 
 
 void cc2::Map::copyFrom(const cc2::Map* map)
+{
+    copyProperties(map);
+    m_mapData = map->m_mapData;
+}
+
+void cc2::Map::copyProperties(const cc2::Map* map)
 {
     m_version = map->m_version;
     m_lock = map->m_lock;
@@ -1240,7 +1639,6 @@ void cc2::Map::copyFrom(const cc2::Map* map)
     m_clue = map->m_clue;
     m_note = map->m_note;
     m_option = map->m_option;
-    m_mapData = map->m_mapData;
     memcpy(m_key, map->m_key, sizeof(m_key));
     m_replay = map->m_replay;
     m_readOnly = map->m_readOnly;
@@ -1346,12 +1744,14 @@ void cc2::Map::read(ccl::Stream* stream)
             if (stream->read(&m_key, 1, sizeof(m_key)) != sizeof(m_key))
                 throw ccl::IOError(ccl::RuntimeError::tr("Read past end of file"));
         } else if (memcmp(tag, "REPL", 4) == 0) {
-            m_replay.resize(size);
-            stream->read(&m_replay[0], 1, size);
+            auto replay = std::make_shared<std::vector<uint8_t>>(size);
+            stream->read(replay->data(), 1, size);
+            m_replay = std::move(replay);
         } else if (memcmp(tag, "PRPL", 4) == 0) {
             std::unique_ptr<ccl::Stream> ustream = stream->unpack(size);
-            m_replay.resize(ustream->size());
-            ustream->read(&m_replay[0], 1, ustream->size());
+            auto replay = std::make_shared<std::vector<uint8_t>>(ustream->size());
+            ustream->read(replay->data(), 1, ustream->size());
+            m_replay = std::move(replay);
         } else if (memcmp(tag, "RDNY", 4) == 0) {
             m_readOnly = true;
             stream->seek(size, SEEK_CUR);
@@ -1361,8 +1761,9 @@ void cc2::Map::read(ccl::Stream* stream)
         } else {
             fprintf(stderr, "Warning: Unrecognized field '%c%c%c%c' in map file.\n",
                     tag[0], tag[1], tag[2], tag[3]);
-            m_unknown.emplace_back();
-            CC2FieldStorage& unknown = m_unknown.back();
+            std::vector<CC2FieldStorage>& unknownFields = detach(m_unknown);
+            unknownFields.emplace_back();
+            CC2FieldStorage& unknown = unknownFields.back();
             memcpy(unknown.tag, tag, sizeof(unknown.tag));
             unknown.data.resize(size);
             stream->read(&unknown.data[0], 1, size);
@@ -1413,7 +1814,7 @@ void writeTaggedBlock(ccl::Stream* stream, const char* tag, const void* data = n
     }
 }
 
-void cc2::Map::write(ccl::Stream* stream) const
+void cc2::Map::write(ccl::Stream* stream, ccl::Stream::PackMode packMode) const
 {
     // Always required
     writeTaggedString(stream, "CC2M", m_version);
@@ -1437,20 +1838,24 @@ void cc2::Map::write(ccl::Stream* stream) const
 
     ccl::BufferStream unpackedMap;
     m_mapData.write(&unpackedMap);
-    writeTagged(stream, "PACK", [&unpackedMap](ccl::Stream* s) { s->pack(&unpackedMap); });
+    writeTagged(stream, "PACK", [&unpackedMap, packMode](ccl::Stream* s) {
+        s->pack(&unpackedMap, packMode);
+    });
     writeTaggedBlock<sizeof(m_key)>(stream, "KEY ", m_key);
 
     // Ensure any unrecognized fields are preserved upon write
-    for (const auto& unknown : m_unknown) {
+    for (const auto& unknown : *m_unknown) {
         writeTagged(stream, unknown.tag, [&unknown](ccl::Stream* s) {
             s->write(&unknown.data[0], 1, unknown.data.size());
         });
     }
 
-    if (!m_replay.empty()) {
+    if (!m_replay->empty()) {
         ccl::BufferStream unpackedReplay;
-        unpackedReplay.write(&m_replay[0], 1, m_replay.size());
-        writeTagged(stream, "PRPL", [&unpackedReplay](ccl::Stream* s) { s->pack(&unpackedReplay); });
+        unpackedReplay.write(m_replay->data(), 1, m_replay->size());
+        writeTagged(stream, "PRPL", [&unpackedReplay, packMode](ccl::Stream* s) {
+            s->pack(&unpackedReplay, packMode);
+        });
     }
 
     if (m_readOnly)
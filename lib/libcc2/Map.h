@@ -22,6 +22,8 @@
 
 #include <vector>
 #include <tuple>
+#include <memory>
+#include <unordered_map>
 #include <stdexcept>
 
 namespace ccl { class LevelData; }
@@ -222,18 +224,20 @@ public:
         Canopy = 0x10,
     };
 
-    Tile() : m_type(Floor), m_direction(), m_tileFlags(), m_modifier(), m_lower() { }
+    Tile()
+        : m_type(Floor), m_direction(), m_tileFlags(), m_below(Standalone),
+          m_modifier(), m_lower() { }
 
     explicit Tile(int type, uint32_t modifier = 0)
-        : m_type(type), m_direction(), m_tileFlags(), m_modifier(modifier),
-          m_lower()
+        : m_type(type), m_direction(), m_tileFlags(), m_below(Standalone),
+          m_modifier(modifier), m_lower()
     {
         checkLower();
     }
 
     Tile(int type, Direction dir, uint32_t modifier)
-        : m_type(type), m_direction(dir), m_tileFlags(), m_modifier(modifier),
-          m_lower()
+        : m_type(type), m_direction(dir), m_tileFlags(), m_below(Standalone),
+          m_modifier(modifier), m_lower()
     {
         checkLower();
     }
@@ -257,8 +261,11 @@ public:
     Tile(const Tile& copy);
     Tile& operator=(const Tile& copy);
 
+    // A new tile is never in a map's arena, so moving into one can't fail.
+    // Assigning to a tile in an arena copies, and throws if the source has
+    // more layers than the arena can hold.
     Tile(Tile&& move) noexcept;
-    Tile& operator=(Tile&& move) noexcept;
+    Tile& operator=(Tile&& move);
 
     bool operator==(const Tile& other) const;
     bool operator!=(const Tile& other) const { return !operator==(other); }
@@ -266,6 +273,9 @@ public:
     Type type() const { return (Type)m_type; }
     void setType(int type)
     {
+        // The bottom record of a stack in a map's arena can't get a lower layer
+        if (m_below == 0 && haveLower(type))
+            tooManyLayers();
         m_type = type;
         checkLower();
     }
@@ -282,25 +292,41 @@ public:
     void read(ccl::Stream* stream);
     void write(ccl::Stream* stream) const;
 
-    Tile* lower() { return haveLower() ? m_lower : nullptr; }
-    const Tile* lower() const { return haveLower() ? m_lower : nullptr; }
+    Tile* lower() { return const_cast<Tile*>(static_cast<const Tile*>(this)->lower()); }
+    const Tile* lower() const
+    {
+        if (!haveLower())
+            return nullptr;
+        if (m_below == Standalone)
+            return m_lower;
+        return m_below ? this + 1 : nullptr;
+    }
 
     Tile& bottom()
     {
         Tile* tp = this;
-        while (tp->haveLower())
-            tp = tp->m_lower;
+        while (tp->lower())
+            tp = tp->lower();
         return *tp;
     }
 
     const Tile& bottom() const
     {
         const Tile* tp = this;
-        while (tp->haveLower())
-            tp = tp->m_lower;
+        while (tp->lower())
+            tp = tp->lower();
         return *tp;
     }
 
+    // Number of layers, including this one
+    int layerCount() const
+    {
+        int count = 1;
+        for (const Tile* tp = lower(); tp; tp = tp->lower())
+            ++count;
+        return count;
+    }
+
     bool haveTile(Tile::Type type) const;
     bool haveTile(const std::vector<Tile::Type>& types) const;
 
@@ -356,24 +382,103 @@ public:
     void rotateRight();
 
 private:
+    friend class TileStore;
+
     uint8_t m_type;
     uint8_t m_direction;
     uint8_t m_tileFlags;
 
+    // Tiles stored in a TileStore are layer records in a stack, and their
+    // lower layer is the next record.  This counts the records left below
+    // this one in the stack.  Any other tile owns its lower layer through
+    // m_lower instead.
+    enum { Standalone = 0xFF };
+    uint8_t m_below;
+
     // Attached modifier value, if any
     uint32_t m_modifier;
 
-    // Lower-layer tile, if any (All tile data may recurse!)
+    // Lower-layer tile of a standalone tile, if any (All tile data may recurse!)
     Tile* m_lower;
 
     // This will create the lower layer if necessary
     Tile* checkLower();
+
+    [[noreturn]] static void tooManyLayers();
 };
 
+/* Backing store for the tile stacks of a map and all of its copies.  Each
+ * stack is MaxLayers consecutive Tile records, allocated in blocks which
+ * never move.  Interned stacks are immutable, and shared by every cell
+ * holding the same tiles.  A cell being edited gets a private stack.
+ * Interned stacks live as long as the store does.  The store isn't thread
+ * safe, so a map and its copies must stay on one thread. */
+class TileStore {
+public:
+    // Layer records reserved for each stack.  A valid CC2 tile has at most
+    // five layers (terrain, item, item marker, mob and panel/canopy).
+    enum { MaxLayers = 8 };
+
+    // Handle of the interned plain Floor stack
+    enum { FloorStack = 0 };
+
+    TileStore();
+    ~TileStore();
+
+    TileStore(const TileStore&) = delete;
+    TileStore& operator=(const TileStore&) = delete;
+
+    Tile* stack(uint32_t handle)
+    {
+        return m_blocks[handle / BlockStacks] + ((handle % BlockStacks) * MaxLayers);
+    }
+
+    const Tile* stack(uint32_t handle) const
+    {
+        return m_blocks[handle / BlockStacks] + ((handle % BlockStacks) * MaxLayers);
+    }
+
+    bool isInterned(uint32_t handle) const { return m_interned[handle]; }
+
+    // New private stacks, either plain Floor or a copy of another stack
+    uint32_t allocate();
+    uint32_t detach(uint32_t handle);
+    void release(uint32_t handle);
+
+    // Makes a private stack immutable, and returns the interned stack with
+    // the same tiles.  The private stack is released if one already existed.
+    uint32_t intern(uint32_t handle);
+
+    // Decodes a stack from the bytes in [data, end), advancing data past
+    // it, and returns its interned handle.  A private stack is only
+    // allocated if the tiles are new to the store.
+    uint32_t decode(const uint8_t*& data, const uint8_t* end);
+
+private:
+    enum { BlockStacks = 256 };
+
+    // Stack for reading tiles before they are known to be unique
+    Tile m_scratch[MaxLayers];
+
+    static int stackDepth(const Tile* records);
+    uint32_t find(const Tile* records, size_t hash) const;
+
+    std::vector<Tile*> m_blocks;
+    std::vector<bool> m_interned;
+    std::vector<uint32_t> m_free;
+    std::unordered_multimap<size_t, uint32_t> m_index;
+};
+
+/* A map's cells are handles to stacks in a TileStore.  Rows of handles are
+ * shared between copies of a map until one of them edits the row, so a copy
+ * (such as an undo snapshot) only costs the rows changed afterward.  Copying
+ * interns the cells edited since the last copy, so a reference returned by
+ * tile() is invalidated by copying the map, as well as by resizing or
+ * reading it. */
 class MapData {
 public:
-    MapData() : m_width(), m_height(), m_map() { }
-    ~MapData() { delete[] m_map; }
+    MapData() : m_width(), m_height() { }
+    ~MapData() { releaseCells(); }
 
     MapData(const MapData& other);
     MapData& operator=(const MapData& other);
@@ -394,23 +499,66 @@ public:
     std::tuple<int, int> countChips() const;
     std::tuple<int, int> countPoints() const;
 
+    // Gives the cell a private stack (and row) if it doesn't have one yet
     Tile& tile(int x, int y)
     {
-        if (!m_map || x >= m_width || y >= m_height)
+        if (x >= m_width || y >= m_height)
             throw std::out_of_range("Map index out of bounds");
-        return m_map[(y * m_width) + x];
+        Row& row = editRow(y);
+        uint32_t& handle = row.cells[x];
+        if (m_store->isInterned(handle)) {
+            handle = m_store->detach(handle);
+            row.edited = true;
+        }
+        return *m_store->stack(handle);
     }
 
     const Tile& tile(int x, int y) const
     {
-        if (!m_map || x >= m_width || y >= m_height)
+        if (x >= m_width || y >= m_height)
             throw std::out_of_range("Map index out of bounds");
-        return m_map[(y * m_width) + x];
+        return *m_store->stack(m_rows[y]->cells[x]);
+    }
+
+    // Whether the cell holds the same tiles as the same cell in other.
+    // Interned cells of copies of the same map compare by handle.
+    bool sameTile(int x, int y, const MapData& other) const;
+
+    // Whether the row is still shared with other, so every cell in it
+    // holds the same tiles
+    bool sameRow(int y, const MapData& other) const
+    {
+        return y < m_height && y < other.m_height && m_rows[y] == other.m_rows[y];
     }
 
 private:
+    // Stack handles for a row of cells.  Only a row that isn't shared can
+    // hold private stacks.  Copying a map interns them, so rows change
+    // even when the map is const.
+    struct Row {
+        std::vector<uint32_t> cells;
+        bool edited;    // Has private stacks
+
+        explicit Row(size_t width)
+            : cells(width, TileStore::FloorStack), edited() { }
+    };
+
     uint8_t m_width, m_height;
-    Tile* m_map;
+    std::vector<std::shared_ptr<Row>> m_rows;
+    std::shared_ptr<TileStore> m_store;
+
+    Row& editRow(int y)
+    {
+        std::shared_ptr<Row>& row = m_rows[y];
+        if (row.use_count() > 1)
+            row = std::make_shared<Row>(*row);
+        return *row;
+    }
+
+    void internRow(int y) const;
+    void releaseRow(int y);
+    void internCells() const;
+    void releaseCells();
 };
 
 struct CC2FieldStorage
@@ -421,7 +569,10 @@ struct CC2FieldStorage
 
 class Map {
 public:
-    Map() : m_refs(1), m_version("7"), m_key(), m_readOnly() { }
+    Map()
+        : m_refs(1), m_version("7"), m_key(), m_readOnly(),
+          m_replay(std::make_shared<std::vector<uint8_t>>()),
+          m_unknown(std::make_shared<std::vector<CC2FieldStorage>>()) { }
     ~Map() = default;
 
     Map(const Map&) = delete;
@@ -430,8 +581,12 @@ public:
     void copyFrom(const cc2::Map* map);
     void importFrom(const ccl::LevelData* level, bool autoResize);
 
+    // Copies everything except the map data
+    void copyProperties(const cc2::Map* map);
+
     void read(ccl::Stream* stream);
-    void write(ccl::Stream* stream) const;
+    void write(ccl::Stream* stream,
+               ccl::Stream::PackMode packMode = ccl::Stream::PackGreedy) const;
 
     std::string version() const { return m_version; }
     std::string lock() const { return m_lock; }
@@ -457,12 +612,12 @@ public:
     MapData& mapData() { return m_mapData; }
     const MapData& mapData() const { return m_mapData; }
 
-    std::vector<uint8_t>& replay() { return m_replay; }
-    const std::vector<uint8_t>& replay() const { return m_replay; }
+    std::vector<uint8_t>& replay() { return detach(m_replay); }
+    const std::vector<uint8_t>& replay() const { return *m_replay; }
 
     void discardReplay()
     {
-        m_replay.clear();
+        m_replay = std::make_shared<std::vector<uint8_t>>();
         m_option.setReplayValid(false);
         static const uint8_t zero_md5[16] = { 0 };
         m_option.setReplayMD5(zero_md5);
@@ -500,10 +655,20 @@ private:
     MapOption m_option;
     MapData m_mapData;
     uint8_t m_key[16];
-    std::vector<uint8_t> m_replay;
     bool m_readOnly;
 
-    std::vector<CC2FieldStorage> m_unknown;
+    // These are shared with copies of the map (such as undo snapshots)
+    // until one of them changes
+    std::shared_ptr<std::vector<uint8_t>> m_replay;
+    std::shared_ptr<std::vector<CC2FieldStorage>> m_unknown;
+
+    template <typename T>
+    static T& detach(std::shared_ptr<T>& shared)
+    {
+        if (shared.use_count() > 1)
+            shared = std::make_shared<T>(*shared);
+        return *shared;
+    }
 };
 
 class ClipboardMap {
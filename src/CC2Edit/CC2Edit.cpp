@@ -1105,8 +1105,8 @@ bool CC2EditMain::loadMap(const QString& filename, bool floatTab)
         }
     }
 
-    ccl::FileStream fs;
-    if (!fs.open(filename, ccl::FileStream::Read)) {
+    ccl::MappedStream fs;
+    if (!fs.open(filename)) {
         QMessageBox::critical(this, tr("Error loading map"),
                 tr("Could not open %1 for reading.").arg(filename));
         return false;
@@ -1139,8 +1139,8 @@ bool CC2EditMain::loadScript(const QString& filename)
     connect(&mapLoader, &ScriptMapLoader::mapAdded, this,
             [this](int levelNum, const QString& filename) {
         cc2::Map map;
-        ccl::FileStream fs;
-        if (fs.open(filename, ccl::FileStream::Read)) {
+        ccl::MappedStream fs;
+        if (fs.open(filename)) {
             try {
                 map.read(&fs);
             } catch (const ccl::RuntimeError& err) {
@@ -2322,11 +2322,13 @@ void CC2EditMain::onTilePicked(int x, int y)
     if (m_currentDrawMode == CC2EditorWidget::DrawInspectTile) {
         TileInspector inspector(this);
         inspector.setTileset(m_currentTileset);
-        cc2::Tile& tile = editor->map()->mapData().tile(x, y);
-        inspector.loadTile(tile);
+        const cc2::Map* map = editor->map();
+        inspector.loadTile(map->mapData().tile(x, y));
         if (inspector.exec() == QDialog::Accepted) {
+            // Starting the edit copies the map, so the cell can't be
+            // looked up until afterward
             editor->beginEdit(CC2EditHistory::EditMap);
-            tile = inspector.tile();
+            editor->map()->mapData().tile(x, y) = inspector.tile();
             editor->endEdit();
         }
     } else if (m_currentDrawMode == CC2EditorWidget::DrawInspectHint) {
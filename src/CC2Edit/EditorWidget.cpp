@@ -23,6 +23,7 @@
 #include <QPainter>
 #include <QPaintEvent>
 #include <QMouseEvent>
+#include <QPolygon>
 #include <queue>
 
 static CC2EditorWidget::CombineMode select_cmode(Qt::KeyboardModifiers keys)
@@ -109,7 +110,7 @@ static void plot_line(CC2EditorWidget* self, QPoint from, QPoint to,
 static void plot_flood(CC2EditorWidget* self, QPoint start,
                        const cc2::Tile& drawTile, CC2EditorWidget::CombineMode mode)
 {
-    cc2::MapData& map = self->map()->mapData();
+    const cc2::MapData& map = self->map()->mapData();
     const cc2::Tile replaceTile = map.tile(start.x(), start.y());
 
     std::queue<QPoint> floodQueue;
@@ -232,6 +233,7 @@ void CC2EditorWidget::setMap(cc2::Map* map)
     resize(sizeHint());
 
     m_undoStack->clear();
+    m_movePaths.clear();
     dirtyBuffer();
 
     m_selectRect = QRect(-1, -1, -1, -1);
@@ -286,6 +288,8 @@ void CC2EditorWidget::beginEdit(CC2EditHistory::Type type)
 void CC2EditorWidget::endEdit()
 {
     if (m_undoCommand->leave(m_map)) {
+        // The command may be merged and deleted by the push
+        invalidatePaths(m_undoCommand);
         const int editType = m_undoCommand->id();
         m_undoStack->push(m_undoCommand);
         if (editType == CC2EditHistory::EditMap)
@@ -365,42 +369,21 @@ void CC2EditorWidget::renderTo(QPainter& painter)
     const cc2::MapData& mapData = m_map->mapData();
     if ((m_paintFlags & ShowMovePaths) != 0) {
         painter.setPen(QColor(0, 127, 255));
-        std::vector<uint8_t> looked;
-        looked.resize(mapData.width() * mapData.height());
-
         for (int y = 0; y < mapData.height(); ++y) {
             for (int x = 0; x < mapData.width(); ++x) {
                 const cc2::Tile* tile = &mapData.tile(x, y);
+                int index = 0;
                 while (tile && (tile = findCreature(tile)) != nullptr) {
-                    std::fill(looked.begin(), looked.end(), 0);
-                    cc2::MoveState move = cc2::CheckMove(mapData, tile, x, y);
-
-                    cc2::Tile tmpCre(*tile);
-                    QPoint from(x, y);
-                    do {
-                        looked[(from.y() * mapData.width()) + from.x()] |= 1 << (int)tmpCre.direction();
-                        if ((move & cc2::MoveDirMask) < cc2::MoveBlocked) {
-                            if ((move & cc2::MoveTrapped) != 0)
-                                break;
-
-                            QPoint to = cc2::AdvanceCreature(from, move);
-                            painter.drawLine(calcPathCenter(from.x(), from.y()),
-                                             calcPathCenter(to.x(), to.y()));
-                            if ((move & cc2::MoveDeath) != 0)
-                                break;
-                            if ((move & cc2::MoveTeleport) != 0) {
-                                //TODO
-                                break;
-                            }
-                            from = to;
-                            cc2::TurnCreature(&tmpCre, move);
-                        } else {
-                            break;
-                        }
-                        move = cc2::CheckMove(mapData, &tmpCre, from.x(), from.y());
-                    } while ((looked[(from.y() * mapData.width()) + from.x()]
-                               & (1 << (int)tmpCre.direction())) == 0);
-
+                    const cc2::CreaturePaths::Path& path = m_movePaths.path(mapData, tile, x, y, index++);
+                    for (const std::vector<QPoint>& run : path.runs) {
+                        if (run.size() < 2)
+                            continue;
+                        QPolygon line;
+                        line.reserve((int)run.size());
+                        for (const QPoint& pos : run)
+                            line << calcPathCenter(pos.x(), pos.y());
+                        painter.drawPolyline(line);
+                    }
                     tile = tile->lower();
                 }
             }
@@ -785,6 +768,9 @@ void CC2EditorWidget::mouseMoveEvent(QMouseEvent* event)
         if (m_drawMode == DrawPencil) {
             putTile(curTile, posX, posY, select_cmode(event->modifiers()));
         } else if (m_drawMode >= DrawLine && m_drawMode <= DrawFill) {
+            // Paths traced through the previous preview are stale once
+            // its cells are reverted
+            m_movePaths.invalidate(m_editCache->mapData(), m_map->mapData());
             m_map->copyFrom(m_editCache);
             // Draw current pending operation
             switch (m_drawMode) {
@@ -1173,14 +1159,15 @@ static bool matchTiles(const cc2::Tile& first, const cc2::Tile& second, ReplaceM
 
 static void pushTile(cc2::Tile& destTile, cc2::Tile tile, ReplaceMode mode)
 {
+    // The new stack is built outside of the map, since it may briefly have
+    // more layers than the map can hold
     *tile.lower() = destTile;
-    destTile = std::move(tile);
 
     // Remove duplicates (if you REALLY want to stack duplicates, use the
     // tile inspector tool...  Otherwise, this just gets messy)
-    cc2::Tile* tp = destTile.lower();
+    cc2::Tile* tp = tile.lower();
     while (tp) {
-        if (matchTiles(*tp, destTile, mode)) {
+        if (matchTiles(*tp, tile, mode)) {
             cc2::Tile* lower = tp->lower();
             if (lower)
                 *tp = *tp->lower();
@@ -1190,6 +1177,11 @@ static void pushTile(cc2::Tile& destTile, cc2::Tile tile, ReplaceMode mode)
             tp = tp->lower();
         }
     }
+
+    // Leave the tile alone if there's no room for another layer
+    if (tile.layerCount() > cc2::TileStore::MaxLayers)
+        return;
+    destTile = std::move(tile);
 }
 
 static void popTile(cc2::Tile& destTile)
@@ -1338,6 +1330,7 @@ void CC2EditorWidget::putTile(const cc2::Tile& tile, int x, int y, CombineMode m
     else if (!clueTile && curTile.bottom().type() == cc2::Tile::Clue)
         emit clueAdded(x, y);
 
+    m_movePaths.invalidate(x, y);
     dirtyBuffer();
 }
 
@@ -1361,10 +1354,26 @@ void CC2EditorWidget::redo()
     updateForUndoCommand(command);
 }
 
+void CC2EditorWidget::invalidatePaths(const MapUndoCommand* command)
+{
+    if (command->haveSnapshots()) {
+        m_movePaths.invalidate(command->before()->mapData(), command->after()->mapData());
+        return;
+    }
+
+    std::vector<QPoint> cells;
+    cells.reserve(command->changes().size());
+    for (const MapUndoCommand::TileChange& change : command->changes())
+        cells.emplace_back(change.x, change.y);
+    m_movePaths.invalidate(cells);
+}
+
 void CC2EditorWidget::updateForUndoCommand(const QUndoCommand* command)
 {
     auto mapCommand = dynamic_cast<const MapUndoCommand*>(command);
     if (mapCommand) {
+        if (mapCommand->after())
+            invalidatePaths(mapCommand);
         if (mapCommand->id() == CC2EditHistory::EditResizeMap) {
             m_tileBuffer = QPixmap(m_map->mapData().width() * m_tileset->size(),
                                    m_map->mapData().height() * m_tileset->size());
@@ -22,6 +22,7 @@
 #include "History.h"
 #include "libcc2/Tileset.h"
 #include "libcc2/Map.h"
+#include "libcc2/GameLogic.h"
 
 class QPainter;
 class QUndoStack;
@@ -176,6 +177,7 @@ private:
     QPixmap m_tileBuffer;
     QPixmap m_tileCache;
     bool m_cacheDirty;
+    cc2::CreaturePaths m_movePaths;
 
     QRect calcTileRect(int x, int y, int w = 1, int h = 1) const
     {
@@ -210,6 +212,7 @@ private:
     void addWireTunnel(cc2::Tile& tile, cc2::Tile::Direction direction);
     void delWire(cc2::Tile& tile, cc2::Tile::Direction direction);
 
+    void invalidatePaths(const MapUndoCommand* command);
     void updateForUndoCommand(const QUndoCommand* command);
 };
 
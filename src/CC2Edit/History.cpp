@@ -20,7 +20,7 @@
 
 MapUndoCommand::MapUndoCommand(CC2EditHistory::Type type, cc2::Map* before)
     : m_enter(1), m_type(type), m_targetMap(before),
-      m_before(new cc2::Map), m_after()
+      m_before(new cc2::Map), m_after(), m_snapshots(true)
 {
     m_targetMap->ref();
     m_before->copyFrom(before);
@@ -43,7 +43,10 @@ bool MapUndoCommand::mergeWith(const QUndoCommand* command)
 
     auto mapCommand = dynamic_cast<const MapUndoCommand*>(command);
     Q_ASSERT(mapCommand);
-    m_after->copyFrom(mapCommand->m_after);
+    if (m_snapshots || mapCommand->m_snapshots || !m_changes.empty()
+            || !mapCommand->m_changes.empty())
+        return false;
+    m_after->copyProperties(mapCommand->m_after);
 
     // Don't bother comparing map edits, since those are never merged
     if (m_before->version() == m_after->version()
@@ -66,18 +69,59 @@ bool MapUndoCommand::leave(cc2::Map* after)
         if (after) {
             m_after = new cc2::Map;
             m_after->copyFrom(after);
+            if (m_type != CC2EditHistory::EditResizeMap)
+                captureChanges();
         }
         return true;
     }
     return false;
 }
 
+void MapUndoCommand::captureChanges()
+{
+    const cc2::MapData& before = m_before->mapData();
+    const cc2::MapData& after = m_after->mapData();
+    if (before.width() != after.width() || before.height() != after.height())
+        return;
+
+    // Rows the edit didn't touch are still shared between the snapshots
+    for (int y = 0; y < after.height(); ++y) {
+        if (after.sameRow(y, before))
+            continue;
+        for (int x = 0; x < after.width(); ++x) {
+            if (!after.sameTile(x, y, before)) {
+                m_changes.push_back(TileChange {
+                    (uint8_t)x, (uint8_t)y, before.tile(x, y), after.tile(x, y)
+                });
+            }
+        }
+    }
+
+    m_before->mapData().resize(0, 0);
+    m_after->mapData().resize(0, 0);
+    m_snapshots = false;
+}
+
+void MapUndoCommand::applyChanges(const cc2::Map* properties, bool undo)
+{
+    m_targetMap->copyProperties(properties);
+    cc2::MapData& mapData = m_targetMap->mapData();
+    for (const TileChange& change : m_changes)
+        mapData.tile(change.x, change.y) = undo ? change.before : change.after;
+}
+
 void MapUndoCommand::undo()
 {
-    m_targetMap->copyFrom(m_before);
+    if (m_snapshots)
+        m_targetMap->copyFrom(m_before);
+    else
+        applyChanges(m_before, true);
 }
 
 void MapUndoCommand::redo()
 {
-    m_targetMap->copyFrom(m_after);
+    if (m_snapshots)
+        m_targetMap->copyFrom(m_after);
+    else
+        applyChanges(m_after, false);
 }
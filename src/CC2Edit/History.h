@@ -19,11 +19,7 @@
 #define _CC2_HISTORY_H
 
 #include <QUndoCommand>
-
-namespace cc2
-{
-    class Map;
-}
+#include "libcc2/Map.h"
 
 namespace CC2EditHistory {
     enum Type {
@@ -34,6 +30,11 @@ namespace CC2EditHistory {
 
 class MapUndoCommand : public QUndoCommand {
 public:
+    struct TileChange {
+        uint8_t x, y;
+        cc2::Tile before, after;
+    };
+
     MapUndoCommand(CC2EditHistory::Type type, cc2::Map* before);
     ~MapUndoCommand() override;
 
@@ -46,12 +47,25 @@ public:
     void undo() override;
     void redo() override;
 
+    const cc2::Map* before() const { return m_before; }
+    const cc2::Map* after() const { return m_after; }
+
+    // Edits that don't resize the map only keep the cells they changed,
+    // in reading order.  The before and after maps then have no map data.
+    bool haveSnapshots() const { return m_snapshots; }
+    const std::vector<TileChange>& changes() const { return m_changes; }
+
 private:
     int m_enter;
     int m_type;
     cc2::Map* m_targetMap;
     cc2::Map* m_before;
     cc2::Map* m_after;
+    bool m_snapshots;
+    std::vector<TileChange> m_changes;
+
+    void captureChanges();
+    void applyChanges(const cc2::Map* properties, bool undo);
 };
 
 #endif
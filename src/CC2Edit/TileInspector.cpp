@@ -187,6 +187,13 @@ void TileInspector::loadTile(const cc2::Tile& tile)
 
 void TileInspector::tryAccept()
 {
+    if (m_tile.layerCount() > cc2::TileStore::MaxLayers) {
+        QMessageBox::critical(this, tr("Invalid Tile"),
+                tr("This tile has %1 layers.  A tile can have at most %2 layers.")
+                .arg(m_tile.layerCount()).arg((int)cc2::TileStore::MaxLayers));
+        return;
+    }
+
     int rangeTile = 0;
     for (cc2::Tile* tp = &m_tile; tp; tp = tp->lower()) {
         if (tp->type() == cc2::Tile::Modifier8 || tp->type() == cc2::Tile::Modifier16
@@ -356,6 +363,12 @@ cc2::Tile* TileInspector::tileLayer(int index)
 
 void TileInspector::createLayerAbove()
 {
+    if (m_tile.layerCount() >= cc2::TileStore::MaxLayers) {
+        QMessageBox::critical(this, tr("Too Many Layers"),
+                tr("A tile can have at most %1 layers.").arg((int)cc2::TileStore::MaxLayers));
+        return;
+    }
+
     int layer = m_layers->currentRow();
     cc2::Tile* tile = tileLayer(layer);
 
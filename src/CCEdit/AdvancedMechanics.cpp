@@ -252,7 +252,7 @@ AdvancedMechanicsDialog::AdvancedMechanicsDialog(QWidget* parent)
     m_moveOrderList->setColumnWidth(0, numWidth);
     m_moveOrderList->setColumnWidth(1, pointWidth);
 
-    connect(buttons, &QDialogButtonBox::accepted, this, &AdvancedMechanicsDialog::onAccept);
+    connect(buttons, &QDialogButtonBox::accepted, this, &QDialog::accept);
     connect(buttons, &QDialogButtonBox::rejected, this, &QDialog::reject);
     connect(m_trapList, &QTreeWidget::currentItemChanged,
             this, &AdvancedMechanicsDialog::onTrapSelect);
@@ -408,7 +408,7 @@ QTreeWidgetItem* AdvancedMechanicsDialog::addMoverItem(const ccl::Point& mover)
     return item;
 }
 
-void AdvancedMechanicsDialog::setFrom(ccl::LevelData* level)
+void AdvancedMechanicsDialog::setFrom(const ccl::LevelData* level)
 {
     m_levelData = level;
     m_trapList->clear();
@@ -422,7 +422,7 @@ void AdvancedMechanicsDialog::setFrom(ccl::LevelData* level)
     m_moveOrder.clear();
     m_moveOrder.reserve(MAX_MOVERS);
 
-    std::list<ccl::Trap>::const_iterator trap_iter;
+    std::vector<ccl::Trap>::const_iterator trap_iter;
     for (trap_iter = level->traps().begin(); trap_iter != level->traps().end(); ++trap_iter) {
         m_traps.push_back(*trap_iter);
         addTrapItem(*trap_iter);
@@ -430,7 +430,7 @@ void AdvancedMechanicsDialog::setFrom(ccl::LevelData* level)
     m_actions[ActionAddTrap]->setEnabled(m_traps.size() < MAX_TRAPS);
     onTrapSelect(0, 0);
 
-    std::list<ccl::Clone>::const_iterator clone_iter;
+    std::vector<ccl::Clone>::const_iterator clone_iter;
     for (clone_iter = level->clones().begin(); clone_iter != level->clones().end(); ++clone_iter) {
         m_clones.push_back(*clone_iter);
         addCloneItem(*clone_iter);
@@ -438,7 +438,7 @@ void AdvancedMechanicsDialog::setFrom(ccl::LevelData* level)
     m_actions[ActionAddClone]->setEnabled(m_clones.size() < MAX_CLONES);
     onCloneSelect(0, 0);
 
-    std::list<ccl::Point>::const_iterator move_iter;
+    std::vector<ccl::Point>::const_iterator move_iter;
     for (move_iter = level->moveList().begin(); move_iter != level->moveList().end(); ++move_iter) {
         m_moveOrder.push_back(*move_iter);
         addMoverItem(*move_iter);
@@ -447,12 +447,11 @@ void AdvancedMechanicsDialog::setFrom(ccl::LevelData* level)
     onMoverSelect(0, 0);
 }
 
-void AdvancedMechanicsDialog::onAccept()
+void AdvancedMechanicsDialog::applyTo(ccl::LevelData* level) const
 {
-    m_levelData->traps() = std::list<ccl::Trap>(m_traps.begin(), m_traps.end());
-    m_levelData->clones() = std::list<ccl::Clone>(m_clones.begin(), m_clones.end());
-    m_levelData->moveList() = std::list<ccl::Point>(m_moveOrder.begin(), m_moveOrder.end());
-    accept();
+    level->traps() = m_traps;
+    level->clones() = m_clones;
+    level->moveList() = m_moveOrder;
 }
 
 void AdvancedMechanicsDialog::onTrapSelect(QTreeWidgetItem* item, QTreeWidgetItem*)
@@ -28,7 +28,8 @@ class AdvancedMechanicsDialog : public QDialog {
 
 public:
     AdvancedMechanicsDialog(QWidget* parent = 0);
-    void setFrom(ccl::LevelData* level);
+    void setFrom(const ccl::LevelData* level);
+    void applyTo(ccl::LevelData* level) const;
 
 private:
     enum ActionType {
@@ -70,14 +71,13 @@ private:
     std::vector<ccl::Trap> m_traps;
     std::vector<ccl::Clone> m_clones;
     std::vector<ccl::Point> m_moveOrder;
-    ccl::LevelData* m_levelData;
+    const ccl::LevelData* m_levelData;
 
     QTreeWidgetItem* addTrapItem(const ccl::Trap& trap);
     QTreeWidgetItem* addCloneItem(const ccl::Clone& clone);
     QTreeWidgetItem* addMoverItem(const ccl::Point& mover);
 
 private slots:
-    void onAccept();
     void onTrapSelect(QTreeWidgetItem*, QTreeWidgetItem*);
     void onCloneSelect(QTreeWidgetItem*, QTreeWidgetItem*);
     void onMoverSelect(QTreeWidgetItem*, QTreeWidgetItem*);
@@ -884,29 +884,31 @@ void CCEditMain::loadLevelset(const QString& filename)
     if (!closeLevelset())
         return;
 
-    ccl::LevelsetType type = ccl::DetermineLevelsetType(filename);
+    ccl::MappedStream set;
+    if (!set.open(filename)) {
+        QMessageBox::critical(this, tr("Error opening levelset"),
+                              tr("Error: could not open file %1").arg(filename));
+        return;
+    }
+
+    ccl::LevelsetType type = ccl::DetermineLevelsetType(&set);
     if (type == ccl::LevelsetCcl) {
-        ccl::FileStream set;
-        if (set.open(filename, ccl::FileStream::Read)) {
-            m_levelset = new ccl::Levelset(0);
-            try {
-                m_levelset->read(&set);
-            } catch (const ccl::RuntimeError& e) {
-                QMessageBox::critical(this, tr("Error reading levelset"),
-                                      tr("Error loading levelset: %1").arg(e.message()));
-                delete m_levelset;
-                m_levelset = nullptr;
-                return;
-            }
-        } else {
-            QMessageBox::critical(this, tr("Error opening levelset"),
-                                  tr("Error: could not open file %1").arg(filename));
+        m_levelset = new ccl::Levelset(0);
+        try {
+            m_levelset->read(&set, true);
+        } catch (const ccl::RuntimeError& e) {
+            QMessageBox::critical(this, tr("Error reading levelset"),
+                                  tr("Error loading levelset: %1").arg(e.message()));
+            delete m_levelset;
+            m_levelset = nullptr;
             return;
         }
+        set.close();
         doLevelsetLoad();
         setLevelsetFilename(filename);
         m_useDac = false;
     } else if (type == ccl::LevelsetDac) {
+        set.close();
         ccl::unique_FILE dac = ccl::FileStream::Fopen(filename, ccl::FileStream::ReadText);
         if (!dac) {
             QMessageBox::critical(this, tr("Error opening levelset"),
@@ -926,11 +928,10 @@ void CCEditMain::loadLevelset(const QString& filename)
         QDir searchPath(filename);
         searchPath.cdUp();
 
-        ccl::FileStream set;
-        if (set.open(searchPath.absoluteFilePath(m_dacInfo.m_filename), ccl::FileStream::Read)) {
+        if (set.open(searchPath.absoluteFilePath(m_dacInfo.m_filename))) {
             m_levelset = new ccl::Levelset(0);
             try {
-                m_levelset->read(&set);
+                m_levelset->read(&set, true);
             } catch (const ccl::RuntimeError& e) {
                 QMessageBox::critical(this, tr("Error reading levelset"),
                                       tr("Error loading levelset: %1").arg(e.message()));
@@ -992,7 +993,7 @@ void CCEditMain::doLevelsetLoad()
         // Use iterator for level number since stored level numbers may
         // be meaningless until saved...
         m_levelList->item(i)->setText(QStringLiteral("%1 - %2").arg(i + 1)
-                .arg(ccl::fromLatin1(m_levelset->level(i)->name())));
+                .arg(ccl::fromLatin1(m_levelset->levelName(i))));
     }
     if (!m_levelList->currentItem() && m_levelset->levelCount() > 0)
         m_levelList->setCurrentRow(0);
@@ -1350,14 +1351,9 @@ void CCEditMain::loadLevel(ccl::LevelData* levelPtr)
 
 int CCEditMain::levelIndex(ccl::LevelData* level)
 {
-    if (!m_levelset || !level)
+    if (!m_levelset)
         return -1;
-
-    for (int i = 0; i < m_levelset->levelCount(); ++i) {
-        if (m_levelset->level(i) == level)
-            return i;
-    }
-    return -1;
+    return m_levelset->indexOf(level);
 }
 
 EditorWidget* CCEditMain::getEditorAt(int idx)
@@ -1619,8 +1615,8 @@ void CCEditMain::onCopyAction()
     const QRect selection = editor->selection();
     ccl::ClipboardData cbData(selection.width(), selection.height());
     ccl::LevelData* copyRegion = cbData.levelData();
-    ccl::LevelData* current = editor->levelData();
-    copyRegion->map().copyFrom(editor->levelData()->map(),
+    const ccl::LevelData* current = editor->levelData();
+    copyRegion->map().copyFrom(current->map(),
                                selection.x(), selection.y(), 0, 0,
                                selection.width(), selection.height());
 
@@ -1877,10 +1873,12 @@ void CCEditMain::onAdvancedMechAction()
     AdvancedMechanicsDialog mechDlg(this);
     mechDlg.setFrom(editor->levelData());
     beginEdit(CCEditHistory::EditMap);
-    if (mechDlg.exec() == QDialog::Accepted)
+    if (mechDlg.exec() == QDialog::Accepted) {
+        mechDlg.applyTo(editor->levelData());
         endEdit();
-    else
+    } else {
         cancelEdit();
+    }
 }
 
 void CCEditMain::onInspectTilesToggled(bool mode)
@@ -2530,7 +2528,7 @@ void CCEditMain::onOrganizeAction()
     dlg.loadLevelset(m_levelset);
     if (dlg.exec() == QDialog::Accepted) {
         auto undoCommand = new LevelsetUndoCommand(m_levelset);
-        undoCommand->levelList() = dlg.getLevels();
+        undoCommand->setLevelList(dlg.getLevels());
         m_undoStack->push(undoCommand);
         doLevelsetLoad();
         for (int i = 0; i < m_editorTabs->count(); ++i) {
@@ -20,6 +20,7 @@
 #include <QPaintEvent>
 #include <QMouseEvent>
 #include <queue>
+#include <algorithm>
 #include "libcc1/GameLogic.h"
 #include "CommonWidgets/CCTools.h"
 
@@ -153,7 +154,7 @@ static void plot_flood(EditorWidget* self, QPoint start, tile_t drawTile,
 
 enum ConnType { ConnNone, ConnTrap, ConnTrapRev, ConnClone, ConnCloneRev };
 
-static bool test_start_connect(ccl::LevelData* level, QPoint from)
+static bool test_start_connect(const ccl::LevelData* level, QPoint from)
 {
     if (level->traps().size() < MAX_TRAPS) {
         if ((level->map().getFG(from.x(), from.y()) == ccl::TileTrapButton)
@@ -172,7 +173,7 @@ static bool test_start_connect(ccl::LevelData* level, QPoint from)
     return false;
 }
 
-static ConnType test_connect(ccl::LevelData* level, QPoint from, QPoint to)
+static ConnType test_connect(const ccl::LevelData* level, QPoint from, QPoint to)
 {
     if (level->traps().size() < MAX_TRAPS) {
         if (((level->map().getFG(from.x(), from.y()) == ccl::TileTrapButton)
@@ -249,14 +250,12 @@ static bool isDataResettingPoint(const ccl::Point& point)
 
 static QPoint find_player(ccl::LevelData* levelData)
 {
-    for (int y = 31; y >= 0; --y) {
-        for (int x = 31; x >= 0; --x) {
-            if (levelData->map().getFG(x, y) >= ccl::TilePlayer_N
-                && levelData->map().getFG(x, y) <= ccl::TilePlayer_E)
-                return QPoint(x, y);
-        }
-    }
-    return QPoint(0, 0);
+    // The last player in reading order is the one the game will use
+    const int cell = levelData->map().findTiles(ccl::TilePlayer_N, ccl::TilePlayer_E,
+                                                ccl::LevelMap::LayerFG).last();
+    if (cell < 0)
+        return QPoint(0, 0);
+    return QPoint(ccl::TileMask::cellX(cell), ccl::TileMask::cellY(cell));
 }
 
 
@@ -268,7 +267,7 @@ EditorWidget::EditorWidget(QWidget* parent)
       m_trapNumbers(QStringLiteral(":/res/trap-numbers.png")),
       m_drIcons(QStringLiteral(":/res/dr-icons.png")),
       m_errmk(QStringLiteral(":/res/err-mark.png")),
-      m_lastDir(ccl::DirInvalid), m_zoomFactor(1.0)
+      m_lastDir(ccl::DirInvalid), m_zoomFactor(1.0), m_pathRevision()
 {
     setSizePolicy(QSizePolicy::Fixed, QSizePolicy::Fixed);
     setMouseTracking(true);
@@ -293,6 +292,8 @@ void EditorWidget::setLevelData(ccl::LevelData* level)
 
     m_origin = QPoint(-1, -1);
     m_selectRect = QRect(-1, -1, -1, -1);
+    m_movePaths.clear();
+    syncMovePaths();
     dirtyBuffer();
 
     emit hasSelection(false);
@@ -346,6 +347,9 @@ void EditorWidget::paintEvent(QPaintEvent*)
 
 void EditorWidget::renderTo(QPainter& painter)
 {
+    // Read-only access, so the level's lists aren't marked as modified
+    const ccl::LevelData* level = m_levelData;
+
     if (m_cacheDirty) {
         renderTileBuffer();
         m_tileCache = m_tileBuffer.scaled(sizeHint());
@@ -362,7 +366,7 @@ void EditorWidget::renderTo(QPainter& painter)
 
     if ((m_paintFlags & ShowMovement) != 0) {
         int num = 0;
-        for (const ccl::Point& mover : m_levelData->moveList()) {
+        for (const ccl::Point& mover : level->moveList()) {
             if (!isValidPoint(mover))
                 continue;
             painter.drawPixmap((mover.X + 1) * m_tileset->size() * m_zoomFactor - 16,
@@ -374,7 +378,7 @@ void EditorWidget::renderTo(QPainter& painter)
     if(m_paintFlags & ShowCloneNumbers) {
         int num = 0;
 
-        for (const ccl::Clone& clone : m_levelData->clones()) {
+        for (const ccl::Clone& clone : level->clones()) {
             if(isValidPoint(clone.button)) {
                 painter.drawPixmap((clone.button.X + 1) * m_tileset->size() * m_zoomFactor - 16,
                                    (clone.button.Y + 1) * m_tileset->size() * m_zoomFactor - 10,
@@ -394,7 +398,7 @@ void EditorWidget::renderTo(QPainter& painter)
     if(m_paintFlags & ShowTrapNumbers) {
         int num = 0;
 
-        for (const ccl::Trap& trap : m_levelData->traps()) {
+        for (const ccl::Trap& trap : level->traps()) {
             if(isValidPoint(trap.button)) {
                 painter.drawPixmap((trap.button.X + 1) * m_tileset->size() * m_zoomFactor - 16,
                                    (trap.button.Y + 1) * m_tileset->size() * m_zoomFactor - 10,
@@ -413,7 +417,7 @@ void EditorWidget::renderTo(QPainter& painter)
 
     // When marking the data resetting clone buttons, draw a small icon in the top-right part of the tile
     if(m_paintFlags & ShowDRCloneButtons) {
-        for (const ccl::Clone& clone : m_levelData->clones()) {
+        for (const ccl::Clone& clone : level->clones()) {
             // Mark only the "valid" data resetting clone buttons
             if (isValidPoint(clone.button) && isDataResettingPoint(clone.clone)) {
                 int num_img=0;
@@ -488,37 +492,22 @@ void EditorWidget::renderTo(QPainter& painter)
     }
 
     if ((m_paintFlags & ShowMovePaths) != 0) {
+        syncMovePaths();
         painter.setPen(QColor(0, 127, 255));
-        for (ccl::Point from : m_levelData->moveList()) {
+        for (const ccl::Point& from : level->moveList()) {
             if (!isValidPoint(from))
                 continue;
 
-            uint8_t looked[32*32];
-            memset(looked, 0, sizeof(looked));
-            tile_t tile = m_levelData->map().getFG(from.X, from.Y);
-            ccl::MoveState move = ccl::CheckMove(m_levelData, tile, from.X, from.Y);
-
-            do {
-                looked[(from.Y*32)+from.X] |= 1 << (tile & 0x03);
-                if ((move & ccl::MoveDirMask) < ccl::MoveBlocked) {
-                    if ((move & ccl::MoveTrapped) != 0)
-                        break;
-                    ccl::Point to = ccl::AdvanceCreature(from, move);
-                    painter.drawLine(calcPathCenter(from.X, from.Y),
-                                     calcPathCenter(to.X, to.Y));
-                    if ((move & ccl::MoveDeath) != 0)
-                        break;
-                    if ((move & ccl::MoveTeleport) != 0) {
-                        //TODO
-                        break;
-                    }
-                    from = to;
-                    tile = ccl::TurnCreature(tile, move);
-                } else {
-                    break;
-                }
-                move = ccl::CheckMove(m_levelData, tile, from.X, from.Y);
-            } while ((looked[(from.Y*32)+from.X] & (1 << (tile & 0x03))) == 0);
+            const MovePath& path = movePath(from.X, from.Y);
+            for (const std::vector<QPoint>& run : path.runs) {
+                if (run.size() < 2)
+                    continue;
+                QPolygon line;
+                line.reserve((int)run.size());
+                for (const QPoint& point : run)
+                    line << calcPathCenter(point.x(), point.y());
+                painter.drawPolyline(line);
+            }
         }
     }
 
@@ -544,13 +533,13 @@ void EditorWidget::renderTo(QPainter& painter)
 
     if ((m_paintFlags & ShowButtons) != 0) {
         painter.setPen(QColor(255, 0, 0));
-        for (const auto& trap_iter : m_levelData->traps()) {
+        for (const auto& trap_iter : level->traps()) {
             if (!isValidPoint(trap_iter.button) || !isValidPoint(trap_iter.trap))
                 continue;
             painter.drawLine(calcTileCenter(trap_iter.button.X, trap_iter.button.Y),
                              calcTileCenter(trap_iter.trap.X, trap_iter.trap.Y));
         }
-        for (const auto& clone_iter : m_levelData->clones()) {
+        for (const auto& clone_iter : level->clones()) {
             if (!isValidPoint(clone_iter.button) || !isValidPoint(clone_iter.clone))
                 continue;
             painter.drawLine(calcTileCenter(clone_iter.button.X, clone_iter.button.Y),
@@ -575,7 +564,7 @@ void EditorWidget::renderTo(QPainter& painter)
     if ((m_paintFlags & ShowMultiTankLocations) != 0) {
         std::unordered_map<std::pair<int,int>,int,pair_hash> tankList;
 
-        for (const ccl::Point& mover : m_levelData->moveList()) {
+        for (const ccl::Point& mover : level->moveList()) {
             if (!isValidPoint(mover))
                 continue;
 
@@ -689,6 +678,116 @@ void EditorWidget::renderTo(QPainter& painter)
     }
 }
 
+static bool sameTraps(const std::vector<ccl::Trap>& left,
+                      const std::vector<ccl::Trap>& right)
+{
+    return std::equal(left.begin(), left.end(), right.begin(), right.end(),
+                      [](const ccl::Trap& a, const ccl::Trap& b) {
+        return a.button == b.button && a.trap == b.trap;
+    });
+}
+
+void EditorWidget::syncMovePaths()
+{
+    // Changes made other than through putTile() (undo, the tile inspector,
+    // connection edits, ...) can't be tracked per cell
+    const ccl::LevelData* level = m_levelData;
+    if (m_pathRevision != level->map().revision() || !sameTraps(m_pathTraps, level->traps())) {
+        m_movePaths.clear();
+        m_pathRevision = level->map().revision();
+        m_pathTraps = level->traps();
+    }
+}
+
+// MSCC sends creatures to the previous teleport in reading order, wrapping
+// around the map, and skips teleports whose exit is blocked.  The teleport
+// it entered is tried last, so it can come back out of that one.  The scanned
+// cells and the exits checked are added to the dependencies.
+static bool findTeleportExit(const ccl::LevelData* level, tile_t tile,
+                             ccl::Point* pos, ccl::TileMask& depends)
+{
+    const int numCells = 32 * 32;
+    const int start = (pos->Y * 32) + pos->X;
+    for (int offset = 1; offset <= numCells; ++offset) {
+        const int cell = (start - offset + numCells) % numCells;
+        const int destX = cell % 32, destY = cell / 32;
+        depends.set(destX, destY);
+        if (level->map().getFG(destX, destY) != ccl::TileTeleport
+            && level->map().getBG(destX, destY) != ccl::TileTeleport)
+            continue;
+
+        ccl::TileMask dest;
+        dest.set(destX, destY);
+        depends |= dest.neighbors();
+        const ccl::MoveState move = ccl::CheckMove(level, tile, destX, destY);
+        if ((move & ccl::MoveDirMask) < ccl::MoveBlocked) {
+            pos->X = destX;
+            pos->Y = destY;
+            return true;
+        }
+    }
+    return false;
+}
+
+const EditorWidget::MovePath& EditorWidget::movePath(int x, int y)
+{
+    auto iter = m_movePaths.find(std::make_pair(x, y));
+    if (iter != m_movePaths.end())
+        return iter->second;
+
+    const ccl::LevelData* level = m_levelData;
+    MovePath& path = m_movePaths[std::make_pair(x, y)];
+    ccl::TileMask visited;
+
+    uint8_t looked[32*32];
+    memset(looked, 0, sizeof(looked));
+    ccl::Point from { x, y };
+    tile_t tile = level->map().getFG(from.X, from.Y);
+    ccl::MoveState move = ccl::CheckMove(level, tile, from.X, from.Y);
+    path.runs.emplace_back(1, QPoint(from.X, from.Y));
+
+    do {
+        // CheckMove() looks at the cell, its neighbors, and any trap buttons
+        visited.set(from.X, from.Y);
+        for (const ccl::Point& button : level->linkedTrapButtons(from.X, from.Y))
+            path.depends.set(button.X, button.Y);
+
+        looked[(from.Y*32)+from.X] |= 1 << (tile & 0x03);
+        if ((move & ccl::MoveDirMask) < ccl::MoveBlocked) {
+            if ((move & ccl::MoveTrapped) != 0)
+                break;
+            ccl::Point to = ccl::AdvanceCreature(from, move);
+            path.runs.back().emplace_back(to.X, to.Y);
+            if ((move & ccl::MoveDeath) != 0)
+                break;
+            tile = ccl::TurnCreature(tile, move);
+            if ((move & ccl::MoveTeleport) != 0) {
+                if (!findTeleportExit(level, tile, &to, path.depends))
+                    break;
+                path.runs.emplace_back(1, QPoint(to.X, to.Y));
+            }
+            from = to;
+        } else {
+            break;
+        }
+        move = ccl::CheckMove(level, tile, from.X, from.Y);
+    } while ((looked[(from.Y*32)+from.X] & (1 << (tile & 0x03))) == 0);
+
+    path.depends |= visited | visited.neighbors();
+    return path;
+}
+
+void EditorWidget::invalidatePaths(int x, int y)
+{
+    auto iter = m_movePaths.begin();
+    while (iter != m_movePaths.end()) {
+        if (iter->second.depends.test(x, y))
+            iter = m_movePaths.erase(iter);
+        else
+            ++iter;
+    }
+}
+
 /* This is only used to generate special reports, so no old draw/render state
  * data needs to be saved.
  */
@@ -856,56 +955,49 @@ void EditorWidget::mouseMoveEvent(QMouseEvent* event)
         m_teleportsHilights.clear();
     }
 
-    for (const auto& trap_iter : m_levelData->traps()) {
-        if (trap_iter.button.X == posX && trap_iter.button.Y == posY) {
-            if (isValidPoint(trap_iter.trap))
-                m_hilights << QPoint(trap_iter.trap.X, trap_iter.trap.Y);
-            if (!tipText.isEmpty())
-                tipText += QLatin1Char('\n');
-            tipText += tr("Trap: (%1, %2)")
-                       .arg(trap_iter.trap.X).arg(trap_iter.trap.Y);
+    const ccl::LevelData* level = m_levelData;
+    for (const ccl::Point& trap : level->linkedTraps(posX, posY)) {
+        if (isValidPoint(trap))
+            m_hilights << QPoint(trap.X, trap.Y);
+        if (!tipText.isEmpty())
+            tipText += QLatin1Char('\n');
+        tipText += tr("Trap: (%1, %2)").arg(trap.X).arg(trap.Y);
 
-            if (m_paintFlags & ShowConnectionsOnMouse) {
-                m_trapsHilights.insert(std::make_tuple(trap_iter.button.X,trap_iter.button.Y,trap_iter.trap.X,trap_iter.trap.Y));
-            }
+        if (m_paintFlags & ShowConnectionsOnMouse) {
+            m_trapsHilights.insert(std::make_tuple(posX,posY,trap.X,trap.Y));
         }
-        if (trap_iter.trap.X == posX && trap_iter.trap.Y == posY) {
-            if (isValidPoint(trap_iter.button))
-                m_hilights << QPoint(trap_iter.button.X, trap_iter.button.Y);
-            if (!tipText.isEmpty())
-                tipText += QLatin1Char('\n');
-            tipText += tr("Button: (%1, %2)")
-                       .arg(trap_iter.button.X).arg(trap_iter.button.Y);
+    }
+    for (const ccl::Point& button : level->linkedTrapButtons(posX, posY)) {
+        if (isValidPoint(button))
+            m_hilights << QPoint(button.X, button.Y);
+        if (!tipText.isEmpty())
+            tipText += QLatin1Char('\n');
+        tipText += tr("Button: (%1, %2)").arg(button.X).arg(button.Y);
 
-            if (m_paintFlags & ShowConnectionsOnMouse) {
-                m_trapsHilights.insert(std::make_tuple(trap_iter.button.X,trap_iter.button.Y,trap_iter.trap.X,trap_iter.trap.Y));
-            }
+        if (m_paintFlags & ShowConnectionsOnMouse) {
+            m_trapsHilights.insert(std::make_tuple(button.X,button.Y,posX,posY));
         }
     }
-    for (const auto& clone_iter : m_levelData->clones()) {
-        if (clone_iter.button.X == posX && clone_iter.button.Y == posY) {
-            if (isValidPoint(clone_iter.clone))
-                m_hilights << QPoint(clone_iter.clone.X, clone_iter.clone.Y);
-            if (!tipText.isEmpty())
-                tipText += QLatin1Char('\n');
-            tipText += tr("Cloner: (%1, %2)")
-                       .arg(clone_iter.clone.X).arg(clone_iter.clone.Y);
+    for (const ccl::Point& cloner : level->linkedCloners(posX, posY)) {
+        if (isValidPoint(cloner))
+            m_hilights << QPoint(cloner.X, cloner.Y);
+        if (!tipText.isEmpty())
+            tipText += QLatin1Char('\n');
+        tipText += tr("Cloner: (%1, %2)").arg(cloner.X).arg(cloner.Y);
 
-            if (m_paintFlags & ShowConnectionsOnMouse) {
-                m_clonersHilights.insert(std::make_tuple(clone_iter.button.X,clone_iter.button.Y,clone_iter.clone.X,clone_iter.clone.Y));
-            }
+        if (m_paintFlags & ShowConnectionsOnMouse) {
+            m_clonersHilights.insert(std::make_tuple(posX,posY,cloner.X,cloner.Y));
         }
-        if (clone_iter.clone.X == posX && clone_iter.clone.Y == posY) {
-            if (isValidPoint(clone_iter.button))
-                m_hilights << QPoint(clone_iter.button.X, clone_iter.button.Y);
-            if (!tipText.isEmpty())
-                tipText += QLatin1Char('\n');
-            tipText += tr("Button: (%1, %2)")
-                       .arg(clone_iter.button.X).arg(clone_iter.button.Y);
+    }
+    for (const ccl::Point& button : level->linkedCloneButtons(posX, posY)) {
+        if (isValidPoint(button))
+            m_hilights << QPoint(button.X, button.Y);
+        if (!tipText.isEmpty())
+            tipText += QLatin1Char('\n');
+        tipText += tr("Button: (%1, %2)").arg(button.X).arg(button.Y);
 
-            if (m_paintFlags & ShowConnectionsOnMouse) {
-                m_clonersHilights.insert(std::make_tuple(clone_iter.button.X,clone_iter.button.Y,clone_iter.clone.X,clone_iter.clone.Y));
-            }
+        if (m_paintFlags & ShowConnectionsOnMouse) {
+            m_clonersHilights.insert(std::make_tuple(button.X,button.Y,posX,posY));
         }
     }
 
@@ -944,18 +1036,18 @@ void EditorWidget::mouseMoveEvent(QMouseEvent* event)
     }
 
     if (MONSTER_TILE(m_levelData->map().getFG(posX, posY))) {
-        bool canMove = false;
-        int moveIdx = 0;
-        for (const auto& move_iter : m_levelData->moveList()) {
-            ++moveIdx;
-            if (move_iter.X == posX && move_iter.Y == posY) {
-                if (!tipText.isEmpty())
-                    tipText += QLatin1Char('\n');
-                tipText += tr("Move order: %1").arg(moveIdx);
-                canMove = true;
+        const bool canMove = level->checkMove(posX, posY);
+        if (canMove) {
+            int moveIdx = 0;
+            for (const auto& move_iter : level->moveList()) {
+                ++moveIdx;
+                if (move_iter.X == posX && move_iter.Y == posY) {
+                    if (!tipText.isEmpty())
+                        tipText += QLatin1Char('\n');
+                    tipText += tr("Move order: %1").arg(moveIdx);
+                }
             }
-        }
-        if (!canMove) {
+        } else {
             if (!tipText.isEmpty())
                 tipText += QLatin1Char('\n');
             tipText += tr("Monster DOES NOT MOVE");
@@ -1002,7 +1094,7 @@ void EditorWidget::mousePressEvent(QMouseEvent* event)
         if (m_cachedButton == Qt::RightButton) {
             bool madeChange = false;
             emit editingStarted();
-            std::list<ccl::Trap>::iterator trap_iter = m_levelData->traps().begin();
+            std::vector<ccl::Trap>::iterator trap_iter = m_levelData->traps().begin();
             while (trap_iter != m_levelData->traps().end()) {
                 if ((trap_iter->button.X == posX && trap_iter->button.Y == posY)
                     || (trap_iter->trap.X == posX && trap_iter->trap.Y == posY)) {
@@ -1013,7 +1105,7 @@ void EditorWidget::mousePressEvent(QMouseEvent* event)
                 }
             }
 
-            std::list<ccl::Clone>::iterator clone_iter = m_levelData->clones().begin();
+            std::vector<ccl::Clone>::iterator clone_iter = m_levelData->clones().begin();
             while (clone_iter != m_levelData->clones().end()) {
                 if ((clone_iter->button.X == posX && clone_iter->button.Y == posY)
                     || (clone_iter->clone.X == posX && clone_iter->clone.Y == posY)) {
@@ -1136,6 +1228,11 @@ void EditorWidget::putTile(tile_t tile, int x, int y, DrawLayer layer)
     const tile_t oldUpper = m_levelData->map().getFG(x, y);
     const tile_t oldLower = m_levelData->map().getBG(x, y);
 
+    // Read-only access, so the level's lists aren't marked as modified
+    const ccl::LevelData* level = m_levelData;
+    const bool pathsCurrent = m_pathRevision == level->map().revision()
+                           && sameTraps(m_pathTraps, level->traps());
+
     if (layer == LayTop) {
         if (oldUpper == tile)
             return;
@@ -1225,7 +1322,7 @@ void EditorWidget::putTile(tile_t tile, int x, int y, DrawLayer layer)
     // Clear or add monsters from replaced tiles into move list
     if ((MONSTER_TILE(oldUpper) && (m_levelData->map().getBG(x, y) == ccl::TileCloner))
         || !MONSTER_TILE(m_levelData->map().getFG(x, y))) {
-        std::list<ccl::Point>::iterator move_iter = m_levelData->moveList().begin();
+        std::vector<ccl::Point>::iterator move_iter = m_levelData->moveList().begin();
         while (move_iter != m_levelData->moveList().end()) {
             if (move_iter->X == x && move_iter->Y == y)
                 move_iter = m_levelData->moveList().erase(move_iter);
@@ -1243,7 +1340,7 @@ void EditorWidget::putTile(tile_t tile, int x, int y, DrawLayer layer)
     }
 
     // Clear connections from replaced tiles
-    std::list<ccl::Trap>::iterator trap_iter = m_levelData->traps().begin();
+    std::vector<ccl::Trap>::iterator trap_iter = m_levelData->traps().begin();
     while (trap_iter != m_levelData->traps().end()) {
         if (trap_iter->button.X == x && trap_iter->button.Y == y
                 && m_levelData->map().getFG(x, y) != ccl::TileTrapButton
@@ -1257,7 +1354,7 @@ void EditorWidget::putTile(tile_t tile, int x, int y, DrawLayer layer)
             ++trap_iter;
     }
 
-    std::list<ccl::Clone>::iterator clone_iter = m_levelData->clones().begin();
+    std::vector<ccl::Clone>::iterator clone_iter = m_levelData->clones().begin();
     while (clone_iter != m_levelData->clones().end()) {
         if (clone_iter->button.X == x && clone_iter->button.Y == y
                 && m_levelData->map().getFG(x, y) != ccl::TileCloneButton
@@ -1271,6 +1368,14 @@ void EditorWidget::putTile(tile_t tile, int x, int y, DrawLayer layer)
             ++clone_iter;
     }
 
+    // Only paths that looked at this cell can have changed, including any
+    // through a trap connection removed above
+    if (pathsCurrent) {
+        invalidatePaths(x, y);
+        m_pathRevision = level->map().revision();
+        m_pathTraps = level->traps();
+    }
+
     dirtyBuffer();
 }
 
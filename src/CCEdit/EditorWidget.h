@@ -166,6 +166,22 @@ private:
     QPixmap m_tileCache;
     bool m_cacheDirty;
 
+    // Monster paths for ShowMovePaths, keyed by starting point.  Each path
+    // records the cells CheckMove() looked at, so editing a tile only
+    // retraces the paths that could have changed.  Teleports split a path
+    // into separate runs.
+    struct MovePath {
+        std::vector<std::vector<QPoint>> runs;
+        ccl::TileMask depends;
+    };
+    std::unordered_map<std::pair<int, int>, MovePath, pair_hash> m_movePaths;
+    unsigned int m_pathRevision;
+    std::vector<ccl::Trap> m_pathTraps;
+
+    void syncMovePaths();
+    const MovePath& movePath(int x, int y);
+    void invalidatePaths(int x, int y);
+
     QRect calcTileRect(int x, int y, int w = 1, int h = 1) const
     {
         // Size is calculated inclusively, so -2 is needed to get past
@@ -23,6 +23,7 @@
 #include <QSettings>
 
 #include "CommonWidgets/CCTools.h"
+#include "libcc1/Reachability.h"
 
 enum CheckMode {
     CheckMsccStrict, CheckMscc, CheckTWorldLynx, CheckLynxPedantic,
@@ -154,42 +155,46 @@ void ErrorCheckDialog::checkLevel(int level)
 {
     ccl::LevelData* levelData = m_levelset->level(level);
 
-    int chips = 0, players = 0;
-    bool haveExit = false;
-    for (int y=0; y<32; ++y) {
-        for (int x=0; x<32; ++x) {
-            tile_t fg = levelData->map().getFG(x, y);
-            tile_t bg = levelData->map().getBG(x, y);
-            if (fg == ccl::TileExit || bg == ccl::TileExit)
-                haveExit = true;
-            if (fg == ccl::TileChip)
-                ++chips;
-            if (bg == ccl::TileChip)
-                ++chips;
-            if ((fg & 0xFC) == ccl::TilePlayer_N)
-                ++players;
-            if ((bg & 0xFC) == ccl::TilePlayer_N)
-                reportError(level, tr("[Invalid Tile Combo]\n"
-                                      "Buried player tile at (%1, %2)")
-                                   .arg(x).arg(y));
-            if (m_levelset->type() != ccl::Levelset::TypePG &&
-                m_levelset->type() != ccl::Levelset::TypeLynxPG &&
-                (fg == ccl::TileIceBlock || bg == ccl::TileIceBlock))
-                reportError(level, tr("[Invalid Tile]\n"
-                                      "Use of ice block at (%1, %2) in non-PGChips levelset")
-                                   .arg(x).arg(y));
-            if (fg == ccl::Tile_UNUSED_20 || (fg >= ccl::TilePlayerSplash &&
-                fg <= ccl::TilePlayerSwim_E && fg != ccl::TileIceBlock) ||
-                bg == ccl::Tile_UNUSED_20 || (bg >= ccl::TilePlayerSplash &&
-                bg <= ccl::TilePlayerSwim_E && bg != ccl::TileIceBlock))
-                reportError(level, tr("[Invalid Tile]\n"
-                                      "Use of reserved tile at (%1, %2)")
-                                   .arg(x).arg(y));
-            if (fg >= ccl::NUM_TILE_TYPES || bg >= ccl::NUM_TILE_TYPES)
-                reportError(level, tr("[Invalid Tile]\n"
-                                      "Use of invalid tile at (%1, %2)")
-                                   .arg(x).arg(y));
-        }
+    const ccl::LevelMap& map = levelData->map();
+    const bool haveExit = map.findTiles(ccl::TileExit).any();
+    const int chips = map.countTiles(ccl::TileChip);
+    const int players = map.findTiles(ccl::TilePlayer_N, ccl::TilePlayer_E,
+                                      ccl::LevelMap::LayerFG).count();
+
+    // Only visit cells which might need a report, in reading order so the
+    // reports come out in the same order as a full scan
+    ccl::TileMask suspect = map.findTiles(ccl::TilePlayer_N, ccl::TilePlayer_E,
+                                          ccl::LevelMap::LayerBG);
+    suspect |= map.findTiles(ccl::TileIceBlock);
+    suspect |= map.findTiles(ccl::Tile_UNUSED_20);
+    suspect |= map.findTiles(ccl::TilePlayerSplash, ccl::TilePlayerSwim_E);
+    suspect |= map.findTiles(ccl::NUM_TILE_TYPES, 0xFF);
+    for (int cell = suspect.first(); cell >= 0; cell = suspect.first(cell + 1)) {
+        const int x = ccl::TileMask::cellX(cell);
+        const int y = ccl::TileMask::cellY(cell);
+        tile_t fg = map.getFG(x, y);
+        tile_t bg = map.getBG(x, y);
+        if ((bg & 0xFC) == ccl::TilePlayer_N)
+            reportError(level, tr("[Invalid Tile Combo]\n"
+                                  "Buried player tile at (%1, %2)")
+                               .arg(x).arg(y));
+        if (m_levelset->type() != ccl::Levelset::TypePG &&
+            m_levelset->type() != ccl::Levelset::TypeLynxPG &&
+            (fg == ccl::TileIceBlock || bg == ccl::TileIceBlock))
+            reportError(level, tr("[Invalid Tile]\n"
+                                  "Use of ice block at (%1, %2) in non-PGChips levelset")
+                               .arg(x).arg(y));
+        if (fg == ccl::Tile_UNUSED_20 || (fg >= ccl::TilePlayerSplash &&
+            fg <= ccl::TilePlayerSwim_E && fg != ccl::TileIceBlock) ||
+            bg == ccl::Tile_UNUSED_20 || (bg >= ccl::TilePlayerSplash &&
+            bg <= ccl::TilePlayerSwim_E && bg != ccl::TileIceBlock))
+            reportError(level, tr("[Invalid Tile]\n"
+                                  "Use of reserved tile at (%1, %2)")
+                               .arg(x).arg(y));
+        if (fg >= ccl::NUM_TILE_TYPES || bg >= ccl::NUM_TILE_TYPES)
+            reportError(level, tr("[Invalid Tile]\n"
+                                  "Use of invalid tile at (%1, %2)")
+                               .arg(x).arg(y));
     }
 
     if (!haveExit)
@@ -206,8 +211,20 @@ void ErrorCheckDialog::checkLevel(int level)
         reportError(level, tr("[Design Warning]\n"
                               "Multiple player start tiles are present in the level"));
 
-    std::list<ccl::Trap>::iterator trap_iter;
-    for (trap_iter = levelData->traps().begin(); trap_iter != levelData->traps().end(); ++trap_iter) {
+    if (players == 1) {
+        const ccl::Reachability reach = ccl::FindReachable(levelData);
+        if (haveExit && !(reach.cells & map.findTiles(ccl::TileExit)).any())
+            reportError(level, tr("[Possibly Unsolvable]\n"
+                                  "No exit can be reached from the player start"));
+        if (chips >= levelData->chips() && reach.chips < levelData->chips())
+            reportError(level, tr("[Possibly Unsolvable]\n"
+                                  "Not enough chips can be reached to meet goal (need %1 more)")
+                               .arg(levelData->chips() - reach.chips));
+    }
+
+    const ccl::LevelData* constLevel = levelData;
+    std::vector<ccl::Trap>::const_iterator trap_iter;
+    for (trap_iter = constLevel->traps().begin(); trap_iter != constLevel->traps().end(); ++trap_iter) {
         if (trap_iter->button.X < 0 || trap_iter->button.X > 31 ||
             trap_iter->button.Y < 0 || trap_iter->button.Y > 31)
             reportError(level, tr("[Invalid Trap]\n"
@@ -230,8 +247,8 @@ void ErrorCheckDialog::checkLevel(int level)
                                .arg(trap_iter->trap.X).arg(trap_iter->trap.Y));
     }
 
-    std::list<ccl::Clone>::iterator clone_iter;
-    for (clone_iter = levelData->clones().begin(); clone_iter != levelData->clones().end(); ++clone_iter) {
+    std::vector<ccl::Clone>::const_iterator clone_iter;
+    for (clone_iter = constLevel->clones().begin(); clone_iter != constLevel->clones().end(); ++clone_iter) {
         if (clone_iter->button.X < 0 || clone_iter->button.X > 31 ||
             clone_iter->button.Y < 0 || clone_iter->button.Y > 31)
             reportError(level, tr("[Invalid Cloner]\n"
@@ -254,8 +271,8 @@ void ErrorCheckDialog::checkLevel(int level)
                                .arg(clone_iter->clone.X).arg(clone_iter->clone.Y));
     }
 
-    std::list<ccl::Point>::iterator move_iter;
-    for (move_iter = levelData->moveList().begin(); move_iter != levelData->moveList().end(); ++move_iter) {
+    std::vector<ccl::Point>::const_iterator move_iter;
+    for (move_iter = constLevel->moveList().begin(); move_iter != constLevel->moveList().end(); ++move_iter) {
         if (move_iter->X < 0 || move_iter->X > 31 ||
             move_iter->Y < 0 || move_iter->Y > 31)
             reportError(level, tr("[Invalid Mover]\n"
@@ -275,7 +292,7 @@ void ErrorCheckDialog::checkLevel(int level)
             if (m_checkMode->currentIndex() == CheckLynxPedantic) {
                 if (levelData->map().getFG(x, y) == ccl::TileTrapButton
                     || levelData->map().getBG(x, y) == ccl::TileTrapButton) {
-                    std::list<ccl::Point> targets = levelData->linkedTraps(x, y);
+                    ccl::PointView targets = levelData->linkedTraps(x, y);
                     if (targets.size() == 0) {
                         reportError(level, tr("[Invalid Trap]\n"
                                     "Trap button at (%1, %2) has no connections")
@@ -292,7 +309,7 @@ void ErrorCheckDialog::checkLevel(int level)
                 }
                 if (levelData->map().getFG(x, y) == ccl::TileCloneButton
                     || levelData->map().getBG(x, y) == ccl::TileCloneButton) {
-                    std::list<ccl::Point> targets = levelData->linkedCloners(x, y);
+                    ccl::PointView targets = levelData->linkedCloners(x, y);
                     if (targets.size() == 0) {
                         reportError(level, tr("[Invalid Cloner]\n"
                                     "Clone button at (%1, %2) has no connections")
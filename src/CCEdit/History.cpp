@@ -18,6 +18,8 @@
 #include "History.h"
 #include "libcc1/Levelset.h"
 
+#include <algorithm>
+
 EditorUndoCommand::EditorUndoCommand(CCEditHistory::Type type, ccl::LevelData* before)
     : m_enter(1), m_type(type), m_levelPtr(before),
       m_before(new ccl::LevelData), m_after()
@@ -28,7 +30,8 @@ EditorUndoCommand::EditorUndoCommand(CCEditHistory::Type type, ccl::LevelData* b
 
 EditorUndoCommand::~EditorUndoCommand()
 {
-    m_before->unref();
+    if (m_before)
+        m_before->unref();
     if (m_after)
         m_after->unref();
     m_levelPtr->unref();
@@ -59,70 +62,122 @@ bool EditorUndoCommand::leave(ccl::LevelData* after)
     if (--m_enter == 0) {
         Q_ASSERT(!m_after);
         if (after) {
-            m_after = new ccl::LevelData;
-            m_after->copyFrom(after);
+            const ccl::LevelData* level = after;
+            if (m_type == CCEditHistory::EditMap
+                    && m_before->name() == level->name()
+                    && m_before->hint() == level->hint()
+                    && m_before->password() == level->password()
+                    && m_before->author() == level->author()
+                    && m_before->chips() == level->chips()
+                    && m_before->timer() == level->timer()) {
+                captureChanges(level);
+            } else {
+                m_after = new ccl::LevelData;
+                m_after->copyFrom(after);
+            }
         }
         return true;
     }
     return false;
 }
 
+static bool sameLists(const ccl::LevelData* before, const ccl::LevelData* after)
+{
+    auto sameTrap = [](const ccl::Trap& left, const ccl::Trap& right) {
+        return left.button == right.button && left.trap == right.trap;
+    };
+    auto sameClone = [](const ccl::Clone& left, const ccl::Clone& right) {
+        return left.button == right.button && left.clone == right.clone;
+    };
+    return before->traps().size() == after->traps().size()
+        && std::equal(before->traps().begin(), before->traps().end(),
+                      after->traps().begin(), sameTrap)
+        && before->clones().size() == after->clones().size()
+        && std::equal(before->clones().begin(), before->clones().end(),
+                      after->clones().begin(), sameClone)
+        && before->moveList() == after->moveList();
+}
+
+void EditorUndoCommand::captureChanges(const ccl::LevelData* after)
+{
+    const ccl::LevelData* before = m_before;
+    for (int y = 0; y < CCL_HEIGHT; ++y) {
+        for (int x = 0; x < CCL_WIDTH; ++x) {
+            const tile_t beforeFG = before->map().getFG(x, y);
+            const tile_t beforeBG = before->map().getBG(x, y);
+            const tile_t afterFG = after->map().getFG(x, y);
+            const tile_t afterBG = after->map().getBG(x, y);
+            if (beforeFG != afterFG || beforeBG != afterBG) {
+                m_changes.push_back(TileChange {
+                    (uint8_t)x, (uint8_t)y, beforeFG, beforeBG, afterFG, afterBG
+                });
+            }
+        }
+    }
+
+    if (!sameLists(before, after)) {
+        m_listsBefore.reset(new LevelLists { before->traps(), before->clones(),
+                                             before->moveList() });
+        m_listsAfter.reset(new LevelLists { after->traps(), after->clones(),
+                                            after->moveList() });
+    }
+
+    // Nothing else changed, so the snapshot is no longer needed
+    m_before->unref();
+    m_before = nullptr;
+}
+
+void EditorUndoCommand::applyChanges(bool undo)
+{
+    ccl::LevelMap& map = m_levelPtr->map();
+    for (const TileChange& change : m_changes) {
+        map.setFG(change.x, change.y, undo ? change.beforeFG : change.afterFG);
+        map.setBG(change.x, change.y, undo ? change.beforeBG : change.afterBG);
+    }
+
+    const LevelLists* lists = undo ? m_listsBefore.get() : m_listsAfter.get();
+    if (lists) {
+        m_levelPtr->traps() = lists->traps;
+        m_levelPtr->clones() = lists->clones;
+        m_levelPtr->moveList() = lists->moveList;
+    }
+}
+
 void EditorUndoCommand::undo()
 {
-    m_levelPtr->copyFrom(m_before);
+    if (m_before)
+        m_levelPtr->copyFrom(m_before);
+    else
+        applyChanges(true);
 }
 
 void EditorUndoCommand::redo()
 {
-    m_levelPtr->copyFrom(m_after);
+    if (m_after)
+        m_levelPtr->copyFrom(m_after);
+    else
+        applyChanges(false);
 }
 
 
 LevelsetUndoCommand::LevelsetUndoCommand(ccl::Levelset* levelset)
     : m_levelset(levelset)
 {
-    m_before.resize(m_levelset->levelCount());
-    for (int i = 0; i < m_levelset->levelCount(); ++i) {
-        m_before[i] = m_levelset->level(i);
-        m_before[i]->ref();
-    }
-}
-
-LevelsetUndoCommand::~LevelsetUndoCommand()
-{
-    for (ccl::LevelData* level : m_before)
-        level->unref();
-    for (ccl::LevelData* level : m_after)
-        level->unref();
+    // Levels that haven't been decoded yet stay that way
+    m_levelset->saveLevelList(&m_before);
 }
 
 void LevelsetUndoCommand::captureLevelList(ccl::Levelset* levelset)
 {
-    m_after.resize(levelset->levelCount());
-    for (int i = 0; i < levelset->levelCount(); ++i) {
-        m_after[i] = levelset->level(i);
-        m_after[i]->ref();
-    }
+    levelset->saveLevelList(&m_after);
 }
 
 void LevelsetUndoCommand::undo()
 {
-    while (m_levelset->levelCount() > 0)
-        m_levelset->takeLevel(0)->unref();
-
-    for (ccl::LevelData* level : m_before) {
-        m_levelset->addLevel(level);
-        level->ref();
-    }
+    m_levelset->restoreLevelList(m_before);
 }
 
 void LevelsetUndoCommand::redo()
 {
-    while (m_levelset->levelCount() > 0)
-        m_levelset->takeLevel(0)->unref();
-
-    for (ccl::LevelData* level : m_after) {
-        m_levelset->addLevel(level);
-        level->ref();
-    }
+    m_levelset->restoreLevelList(m_after);
 }
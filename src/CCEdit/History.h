@@ -19,12 +19,9 @@
 #define _CCEHISTORY_H
 
 #include <QUndoCommand>
+#include <memory>
 #include "libcc1/DacFile.h"
-
-namespace ccl {
-    class LevelData;
-    class Levelset;
-}
+#include "libcc1/Levelset.h"
 
 namespace CCEditHistory {
     enum Type {
@@ -50,19 +47,45 @@ public:
     void redo() override;
 
 private:
+    struct TileChange {
+        uint8_t x, y;
+        tile_t beforeFG, beforeBG;
+        tile_t afterFG, afterBG;
+    };
+
+    struct LevelLists {
+        std::vector<ccl::Trap> traps;
+        std::vector<ccl::Clone> clones;
+        std::vector<ccl::Point> moveList;
+    };
+
     int m_enter;
     int m_type;
     ccl::LevelData* m_levelPtr;
+
+    // Full snapshots of the level.  Map edits only keep these until the
+    // edit is finished, unless the edit also changed the level's properties.
     ccl::LevelData* m_before;
     ccl::LevelData* m_after;
+
+    // What a finished map edit changed.  The lists are only kept if the
+    // edit changed them.
+    std::vector<TileChange> m_changes;
+    std::unique_ptr<LevelLists> m_listsBefore, m_listsAfter;
+
+    void captureChanges(const ccl::LevelData* after);
+    void applyChanges(bool undo);
 };
 
 class LevelsetUndoCommand : public QUndoCommand {
 public:
     explicit LevelsetUndoCommand(ccl::Levelset* levelset);
-    ~LevelsetUndoCommand() override;
 
-    std::vector<ccl::LevelData*>& levelList() { return m_after; }
+    // Takes over a reference to each of the levels
+    void setLevelList(std::vector<ccl::LevelData*> levels)
+    {
+        m_after.assign(std::move(levels));
+    }
     void captureLevelList(ccl::Levelset* levelset);
 
     void undo() override;
@@ -70,8 +93,8 @@ public:
 
 private:
     ccl::Levelset* m_levelset;
-    std::vector<ccl::LevelData*> m_before;
-    std::vector<ccl::LevelData*> m_after;
+    ccl::Levelset::LevelList m_before;
+    ccl::Levelset::LevelList m_after;
 };
 
 class LevelsetPropsUndoCommand : public QUndoCommand {
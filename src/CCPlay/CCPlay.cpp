@@ -42,17 +42,17 @@ std::unique_ptr<ccl::Levelset>
 CCPlayMain::loadLevelset(const QString& filename, int* dacLastLevel)
 {
     ccl::LevelsetType type = ccl::DetermineLevelsetType(filename);
-    ccl::FileStream stream;
+    ccl::MappedStream stream;
     std::unique_ptr<ccl::Levelset> levelset;
     if (type == ccl::LevelsetCcl) {
         try {
-            if (!stream.open(filename, ccl::FileStream::Read)) {
+            if (!stream.open(filename)) {
                 QMessageBox::critical(this, tr("Error Reading Levelset"),
                         tr("Error Opening levelset file %1").arg(filename));
                 return {};
             }
             levelset = std::make_unique<ccl::Levelset>();
-            levelset->read(&stream);
+            levelset->read(&stream, true);
         } catch (const ccl::RuntimeError& e) {
             qDebug("Error trying to load %s: %s", qPrintable(filename),
                    qPrintable(e.message()));
@@ -91,10 +91,10 @@ CCPlayMain::loadLevelset(const QString& filename, int* dacLastLevel)
 
         QDir searchPath(filename);
         searchPath.cdUp();
-        if (stream.open(searchPath.absoluteFilePath(dacInfo.m_filename), ccl::FileStream::Read)) {
+        if (stream.open(searchPath.absoluteFilePath(dacInfo.m_filename))) {
             try {
                 levelset = std::make_unique<ccl::Levelset>();
-                levelset->read(&stream);
+                levelset->read(&stream, true);
             } catch (const ccl::RuntimeError& e) {
                 qDebug("Error trying to load %s: %s", qPrintable(filename),
                        qPrintable(e.message()));
@@ -506,7 +506,7 @@ void CCPlayMain::onPlayMSCC()
                     continue;
                 ini.setString(ccl::toLatin1(QStringLiteral("Level%1").arg(i + 1)),
                               ccl::toLatin1(QStringLiteral("%1,%2,%3")
-                                                    .arg(ccl::fromLatin1(levelset->level(i)->password()))
+                                                    .arg(ccl::fromLatin1(levelset->levelPassword(i)))
                                                     .arg(query.value(0).toInt())
                                                     .arg(query.value(1).toInt())));
                 if (i + 1 == curLevel)
@@ -913,12 +913,12 @@ void CCPlayMain::onLevelsetChanged(QTreeWidgetItem* item, QTreeWidgetItem*)
             }
         }
 
-        ccl::LevelData* level = levelset->level(i);
+        const unsigned short timer = levelset->levelTimer(i);
         auto item = new QTreeWidgetItem(m_levelList);
         item->setText(0, QString::number(i + 1));
-        item->setText(1, ccl::fromLatin1(level->name()));
+        item->setText(1, ccl::fromLatin1(levelset->levelName(i)));
         item->setText(2, haveCCX ? ccx.m_levels[i].m_author : QString());
-        item->setText(3, level->timer() == 0 ? QStringLiteral("---") : QString::number(level->timer()));
+        item->setText(3, timer == 0 ? QStringLiteral("---") : QString::number(timer));
         item->setText(4, myTime == 0 ? QStringLiteral("---") : QString::number(myTime));
         item->setText(5, myScore == 0 ? QStringLiteral("---") : QString::number(myScore));
     }
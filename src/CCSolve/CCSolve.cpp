@@ -0,0 +1,148 @@
+/******************************************************************************
+ * This file is part of CCTools.                                              *
+ *                                                                            *
+ * CCTools is free software: you can redistribute it and/or modify            *
+ * it under the terms of the GNU General Public License as published by       *
+ * the Free Software Foundation, either version 3 of the License, or          *
+ * (at your option) any later version.                                        *
+ *                                                                            *
+ * CCTools is distributed in the hope that it will be useful,                 *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with CCTools.  If not, see <http://www.gnu.org/licenses/>.           *
+ ******************************************************************************/
+
+#include <QCoreApplication>
+#include <QStringList>
+#include <QDir>
+#include <cstdio>
+#include "libcc1/Levelset.h"
+#include "libcc1/DacFile.h"
+#include "libcc1/Solver.h"
+#include "libcc1/Errors.h"
+
+static void usage(const char* appName)
+{
+    fprintf(stderr, "Usage: %s [-j threads] levelset.dat|levelset.dac\n", appName);
+}
+
+static bool loadLevelset(const QString& filename, ccl::Levelset* levelset)
+{
+    ccl::MappedStream set;
+    if (!set.open(filename)) {
+        fprintf(stderr, "Error: could not open file %s\n", qPrintable(filename));
+        return false;
+    }
+
+    ccl::LevelsetType type = ccl::DetermineLevelsetType(&set);
+    if (type == ccl::LevelsetDac) {
+        set.close();
+        ccl::unique_FILE dac = ccl::FileStream::Fopen(filename, ccl::FileStream::ReadText);
+        if (!dac) {
+            fprintf(stderr, "Error: could not open file %s\n", qPrintable(filename));
+            return false;
+        }
+
+        ccl::DacFile dacInfo;
+        try {
+            dacInfo.read(dac.get());
+        } catch (const ccl::RuntimeError& e) {
+            fprintf(stderr, "Error loading levelset descriptor: %s\n", qPrintable(e.message()));
+            return false;
+        }
+
+        QDir searchPath(filename);
+        searchPath.cdUp();
+        const QString datName = searchPath.absoluteFilePath(dacInfo.m_filename);
+        if (!set.open(datName)) {
+            fprintf(stderr, "Error: could not open file %s\n", qPrintable(datName));
+            return false;
+        }
+    } else if (type != ccl::LevelsetCcl) {
+        fprintf(stderr, "Cannot determine file type for %s\n", qPrintable(filename));
+        return false;
+    }
+
+    try {
+        levelset->read(&set, true);
+    } catch (const ccl::RuntimeError& e) {
+        fprintf(stderr, "Error loading levelset: %s\n", qPrintable(e.message()));
+        return false;
+    }
+    return true;
+}
+
+static int solveLevelset(const ccl::Levelset& levelset, unsigned int threads)
+{
+    ccl::Solver solver;
+    solver.setThreads(threads);
+    const ccl::Ruleset ruleset = ccl::GameEngine::rulesetFor(&levelset);
+
+    static const char dirNames[] = { '.', 'N', 'W', 'S', 'E' };
+    int unsolvable = 0;
+    for (int i = 0; i < levelset.levelCount(); ++i) {
+        const std::string name = levelset.levelName(i);
+        ccl::SolveResult result;
+        try {
+            result = solver.solve(ruleset, levelset.level(i));
+        } catch (const ccl::RuntimeError& e) {
+            printf("%3d  %-36s  %-10s  %s\n", i + 1, name.c_str(), "ERROR",
+                   qPrintable(e.message()));
+            continue;
+        }
+
+        switch (result.outcome) {
+        case ccl::SolveResult::Solved:
+            printf("%3d  %-36s  %-10s  %4zu moves  ", i + 1, name.c_str(), "SOLVED",
+                   result.moves.size());
+            for (ccl::Direction move : result.moves)
+                putchar(dirNames[move]);
+            putchar('\n');
+            break;
+        case ccl::SolveResult::Unsolvable:
+            printf("%3d  %-36s  %-10s  %zu states\n", i + 1, name.c_str(), "UNSOLVABLE",
+                   result.statesVisited);
+            ++unsolvable;
+            break;
+        default:
+            printf("%3d  %-36s  %-10s  %zu states\n", i + 1, name.c_str(), "GAVE UP",
+                   result.statesVisited);
+            break;
+        }
+    }
+
+    printf("\n%d of %d levels are unsolvable\n", unsolvable, levelset.levelCount());
+    return (unsolvable != 0) ? 2 : 0;
+}
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setOrganizationName(QStringLiteral("CCTools"));
+    QCoreApplication::setApplicationName(QStringLiteral("CCSolve"));
+
+    QStringList args = QCoreApplication::arguments();
+    const QByteArray appName = args.takeFirst().toLocal8Bit();
+    unsigned int threads = 0;
+    if (args.size() >= 2 && args[0] == QStringLiteral("-j")) {
+        bool ok = false;
+        threads = args[1].toUInt(&ok);
+        if (!ok) {
+            usage(appName.constData());
+            return 1;
+        }
+        args.erase(args.begin(), args.begin() + 2);
+    }
+    if (args.size() != 1) {
+        usage(appName.constData());
+        return 1;
+    }
+
+    ccl::Levelset levelset(0);
+    if (!loadLevelset(args[0], &levelset))
+        return 1;
+    return solveLevelset(levelset, threads);
+}
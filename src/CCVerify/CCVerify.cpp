@@ -0,0 +1,194 @@
+/******************************************************************************
+ * This file is part of CCTools.                                              *
+ *                                                                            *
+ * CCTools is free software: you can redistribute it and/or modify            *
+ * it under the terms of the GNU General Public License as published by       *
+ * the Free Software Foundation, either version 3 of the License, or          *
+ * (at your option) any later version.                                        *
+ *                                                                            *
+ * CCTools is distributed in the hope that it will be useful,                 *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with CCTools.  If not, see <http://www.gnu.org/licenses/>.           *
+ ******************************************************************************/
+
+#include <QCoreApplication>
+#include <QStringList>
+#include <QDir>
+#include <cstdio>
+#include <memory>
+#include "libcc1/Levelset.h"
+#include "libcc1/DacFile.h"
+#include "libcc1/Verifier.h"
+#include "libcc1/Errors.h"
+
+static void usage(const char* appName)
+{
+    fprintf(stderr, "Usage: %s [-j threads] [--strict] levelset.dat|levelset.dac solutions.tws\n"
+                    "\n"
+                    "Replays only approximate Tile World, so failed replays only fail the\n"
+                    "run (exit status 2) with --strict.\n",
+            appName);
+}
+
+static bool loadLevelset(const QString& filename, ccl::Levelset* levelset)
+{
+    ccl::MappedStream set;
+    if (!set.open(filename)) {
+        fprintf(stderr, "Error: could not open file %s\n", qPrintable(filename));
+        return false;
+    }
+
+    ccl::LevelsetType type = ccl::DetermineLevelsetType(&set);
+    if (type == ccl::LevelsetDac) {
+        set.close();
+        ccl::unique_FILE dac = ccl::FileStream::Fopen(filename, ccl::FileStream::ReadText);
+        if (!dac) {
+            fprintf(stderr, "Error: could not open file %s\n", qPrintable(filename));
+            return false;
+        }
+
+        ccl::DacFile dacInfo;
+        try {
+            dacInfo.read(dac.get());
+        } catch (const ccl::RuntimeError& e) {
+            fprintf(stderr, "Error loading levelset descriptor: %s\n", qPrintable(e.message()));
+            return false;
+        }
+
+        QDir searchPath(filename);
+        searchPath.cdUp();
+        const QString datName = searchPath.absoluteFilePath(dacInfo.m_filename);
+        if (!set.open(datName)) {
+            fprintf(stderr, "Error: could not open file %s\n", qPrintable(datName));
+            return false;
+        }
+    } else if (type != ccl::LevelsetCcl) {
+        fprintf(stderr, "Cannot determine file type for %s\n", qPrintable(filename));
+        return false;
+    }
+
+    try {
+        levelset->read(&set, true);
+    } catch (const ccl::RuntimeError& e) {
+        fprintf(stderr, "Error loading levelset: %s\n", qPrintable(e.message()));
+        return false;
+    }
+    return true;
+}
+
+static bool loadSolutions(const QString& filename, ccl::TwsFile* solutions)
+{
+    ccl::MappedStream tws;
+    if (!tws.open(filename)) {
+        fprintf(stderr, "Error: could not open file %s\n", qPrintable(filename));
+        return false;
+    }
+
+    try {
+        solutions->read(&tws);
+    } catch (const ccl::RuntimeError& e) {
+        fprintf(stderr, "Error loading solutions: %s\n", qPrintable(e.message()));
+        return false;
+    }
+    return true;
+}
+
+static const char* statusName(const ccl::VerifyResult& result)
+{
+    if (!result.error.isEmpty())
+        return "ERROR";
+    if (!result.hasSolution)
+        return "unsolved";
+
+    switch (result.status) {
+    case ccl::GameWon:
+        return "OK";
+    case ccl::GameDied:
+        return "DIED";
+    case ccl::GameTimeUp:
+        return "TIME UP";
+    default:
+        return "INCOMPLETE";
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setOrganizationName(QStringLiteral("CCTools"));
+    QCoreApplication::setApplicationName(QStringLiteral("CCVerify"));
+
+    QStringList args = QCoreApplication::arguments();
+    const QByteArray appName = args.takeFirst().toLocal8Bit();
+    unsigned int threads = 0;
+    bool strict = false;
+    for ( ;; ) {
+        if (args.size() >= 2 && args[0] == QStringLiteral("-j")) {
+            bool ok = false;
+            threads = args[1].toUInt(&ok);
+            if (!ok) {
+                usage(appName.constData());
+                return 1;
+            }
+            args.erase(args.begin(), args.begin() + 2);
+        } else if (!args.isEmpty() && args[0] == QStringLiteral("--strict")) {
+            strict = true;
+            args.removeFirst();
+        } else {
+            break;
+        }
+    }
+
+    if (args.size() != 2) {
+        usage(appName.constData());
+        return 1;
+    }
+
+    ccl::Levelset levelset(0);
+    ccl::TwsFile solutions;
+    if (!loadLevelset(args[0], &levelset) || !loadSolutions(args[1], &solutions))
+        return 1;
+
+    const std::vector<ccl::VerifyResult> results =
+            ccl::VerifyLevelset(&levelset, solutions, threads);
+
+    int solved = 0, failed = 0, errors = 0;
+    for (const ccl::VerifyResult& result : results) {
+        const std::string name = levelset.levelName(result.levelNum - 1);
+        if (!result.error.isEmpty()) {
+            printf("%3d  %-36s  %-10s  %s\n", result.levelNum, name.c_str(),
+                   statusName(result), qPrintable(result.error));
+        } else if (!result.hasSolution) {
+            printf("%3d  %-36s  %s\n", result.levelNum, name.c_str(),
+                   statusName(result));
+        } else {
+            const uint32_t ticks = result.ticks;
+            printf("%3d  %-36s  %-10s  %4u.%02us", result.levelNum, name.c_str(),
+                   statusName(result), ticks / ccl::GameEngine::TicksPerSecond,
+                   (ticks % ccl::GameEngine::TicksPerSecond) * 100 / ccl::GameEngine::TicksPerSecond);
+            if (result.timeLeft >= 0)
+                printf("  %4d left", result.timeLeft);
+            printf("\n");
+        }
+
+        if (!result.error.isEmpty())
+            ++errors;
+        else if (result.solved())
+            ++solved;
+        else if (result.hasSolution)
+            ++failed;
+    }
+
+    printf("\n%d of %d levels solved, %d solutions failed, %d levels failed to load\n",
+           solved, (int)results.size(), failed, errors);
+
+    // The engines only approximate Tile World, so failed replays only fail
+    // the run when asked to
+    if (errors != 0 || (strict && failed != 0))
+        return 2;
+    return 0;
+}